@@ -0,0 +1,31 @@
+#ifndef BLOCK_POOL
+#define BLOCK_POOL
+
+#include <cstddef>
+#include "constvars.h"
+
+namespace easy_rpc{
+namespace rpc_server{
+/*
+@brief 读缓冲区的内存块池 按2的幂划分大小级别，每个线程各自缓存，取用与归还都无需加锁
+块不做清零，连接处理完大请求后立即归还大块，内存占用取决于正在处理的数据量而不是历史峰值
+*/
+class block_pool{
+public:
+    static const size_t min_block = INIT_BUF_SIZE; //最小的块
+    static const size_t class_count = 14; //大小级别数 最大的块为min_block << 13 (16MB) 可容纳任意合法消息
+    static const size_t max_cached_bytes = 16 * 1048576; //每个线程最多缓存的字节数 超出时归还的块直接释放
+
+    /*
+    @brief 取出一个至少size字节的块
+    @param capacity 返回块的实际大小
+    */
+    static char* acquire(size_t size, size_t& capacity);
+    /*
+    @brief 归还acquire取出的块
+    */
+    static void release(char* block, size_t capacity);
+};
+}
+}
+#endif
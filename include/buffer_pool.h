@@ -0,0 +1,24 @@
+#ifndef BUFFER_POOL
+#define BUFFER_POOL
+
+#include "codec.h"
+
+namespace easy_rpc{
+namespace rpc_server{
+/*
+@brief 回复缓冲区池 每个线程缓存一组已分配好的buffer，取用与归还都无需加锁
+处理函数的结果直接打包进取出的buffer，发送完成后归还，稳定运行时回复路径不再分配内存
+offload模式的结果在计算线程中取出、在io线程中归还，线程缓存为空或已满时与共享的空闲列表成批交换，buffer得以在线程之间循环使用
+*/
+class buffer_pool{
+public:
+    static const size_t max_cached = 64; //每个线程最多缓存的buffer数
+    static const size_t max_shared = 1024; //共享空闲列表最多缓存的buffer数
+    static const size_t max_cached_size = 64 * 1024; //超过该大小的buffer归还时直接释放 避免长期占用内存
+
+    static buffer_type acquire();
+    static void release(buffer_type && buffer);
+};
+}
+}
+#endif
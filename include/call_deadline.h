@@ -0,0 +1,43 @@
+#ifndef CALL_DEADLINE
+#define CALL_DEADLINE
+
+#include <chrono>
+
+namespace easy_rpc{
+namespace rpc_server{
+using deadline_type = std::chrono::steady_clock::time_point;
+static const deadline_type no_deadline = deadline_type::max(); //请求没有携带截止时间
+/*
+@brief 请求的截止时间 由客户端随请求发送剩余时间，服务端收到时换算为本地时间
+Router在调用处理函数期间设置当前线程的截止时间，处理函数可以据此放弃已经来不及完成的工作
+例: if(call_deadline::remaining() < std::chrono::milliseconds(10)) throw std::runtime_error("no time left");
+*/
+class call_deadline{
+public:
+    /*
+    @brief 当前线程正在处理的请求的截止时间 没有截止时间或不在处理函数中时为no_deadline
+    */
+    static deadline_type current();
+    /*
+    @brief 剩余时间 没有截止时间时为milliseconds::max()，已过期时为0
+    */
+    static std::chrono::milliseconds remaining(deadline_type deadline = current());
+    static bool expired(deadline_type deadline){
+        return deadline != no_deadline && std::chrono::steady_clock::now() >= deadline;
+    }
+    /*
+    @brief 截止时间的作用域 结束时恢复之前的截止时间
+    */
+    class scope{
+    public:
+        explicit scope(deadline_type deadline);
+        ~scope();
+        scope(const scope&) = delete;
+        scope& operator=(const scope&) = delete;
+    private:
+        deadline_type prev_;
+    };
+};
+}
+}
+#endif
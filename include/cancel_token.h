@@ -0,0 +1,51 @@
+#ifndef CANCEL_TOKEN
+#define CANCEL_TOKEN
+
+#include <atomic>
+#include <memory>
+
+namespace easy_rpc{
+namespace rpc_server{
+/*
+@brief 请求的取消标志 由连接在收到客户端的取消消息、请求到达截止时间或连接关闭时设置，可以被复制并在任意线程中查询
+只有offload模式(在线程池中排队)与async模式(稍后回复)的请求带有取消标志，其余请求在取消消息到达之前已经处理完成
+Router在调用处理函数期间设置当前线程的取消标志，耗时的处理函数可以定期检查并提前结束
+例: if(cancel_token::current().cancelled()) throw std::runtime_error("cancelled");
+*/
+class cancel_token{
+public:
+    cancel_token() = default; //不可取消
+    static cancel_token create(){
+        cancel_token token;
+        token.flag_ = std::make_shared<std::atomic_bool>(false);
+        return token;
+    }
+    /*
+    @brief 当前线程正在处理的请求的取消标志
+    */
+    static cancel_token current();
+
+    bool cancelled() const{
+        return flag_ && flag_->load(std::memory_order_relaxed);
+    }
+    void cancel() const{
+        if(flag_) flag_->store(true, std::memory_order_relaxed);
+    }
+    /*
+    @brief 取消标志的作用域 结束时恢复之前的取消标志
+    */
+    class scope{
+    public:
+        explicit scope(const cancel_token& token);
+        ~scope();
+        scope(const scope&) = delete;
+        scope& operator=(const scope&) = delete;
+    private:
+        std::shared_ptr<std::atomic_bool> prev_;
+    };
+private:
+    std::shared_ptr<std::atomic_bool> flag_;
+};
+}
+}
+#endif
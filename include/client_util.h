@@ -7,9 +7,41 @@ using string_view = std::string_view;
 #include <boost/utility/string_view.hpp>
 using string_view = boost::string_view;
 #endif
+#include <boost/system/error_code.hpp>
 #include "codec.h"
+#include "constvars.h"
 
 namespace easy_rpc{
+    /*
+    @brief easy_rpc::error_code对应的错误类别 调用以该类别的错误结束时可与error_code直接比较
+    例: ec == make_error_code(error_code::CANCEL)
+    */
+    class rpc_error_category : public boost::system::error_category{
+    public:
+        const char* name() const noexcept override{
+            return "easy_rpc";
+        }
+        std::string message(int ev) const override{
+            switch((error_code)ev){
+                case error_code::OK: return "ok";
+                case error_code::FAIL: return "call failed";
+                case error_code::TIMEOUT: return "call timed out";
+                case error_code::CANCEL: return "call cancelled";
+                case error_code::BADCONNECTION: return "bad connection";
+                default: return "unknown error";
+            }
+        }
+    };
+
+    inline const boost::system::error_category& rpc_category(){
+        static rpc_error_category category;
+        return category;
+    }
+
+    inline boost::system::error_code make_error_code(error_code e){
+        return boost::system::error_code((int)e, rpc_category());
+    }
+
     inline bool has_error(string_view result){
         rpc_server::msgpack_codec codec;
         auto tp = codec.unpack<std::tuple<int>>(result.data(), result.size());
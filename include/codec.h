@@ -1,5 +1,7 @@
 #ifndef CODEC
 #define CODEC
+#include <string>
+#include <string_view>
 #include <msgpack.hpp>
 
 namespace easy_rpc{
@@ -29,6 +31,12 @@ namespace rpc_server{
             return std::string(buffer.data(),buffer.size());
         }
 
+        //处理包含枚举的参数，将参数直接打包到已有的buffer中，避免先生成临时字符串再复制
+        template<typename Arg,typename... Args,typename=typename std::enable_if<std::is_enum<Arg>::value>::type>
+        static void pack_args_to(buffer_type& buffer, Arg arg, Args&&... args){
+            msgpack::pack(buffer,std::forward_as_tuple((int)arg,std::forward<Args>(args)...));
+        }
+
         //用于单一对象的序列化
         template<typename T>
         buffer_type pack(T&& t)const{
@@ -47,8 +55,41 @@ namespace rpc_server{
                 throw std::invalid_argument("unpack failed: Args not match!");
             }
         }
+
+        //反序列化为msgpack对象 字符串与二进制数据直接引用data中的内容而不复制 data需在对象使用期间保持有效
+        const msgpack::object& unpack_ref(const char * data, size_t length){
+            try{
+                msgpack::unpack(msg_, data, length, [](msgpack::type::object_type, std::size_t, void*){return true;});
+                return msg_.get();
+            }catch(...){
+                throw std::invalid_argument("unpack failed: invalid request!");
+            }
+        }
+
+        //反序列化到指定的zone中 与unpack_ref相同不复制字符串 对象本身也不再分配新的zone 随zone一起回收
+        const msgpack::object& unpack_ref(const char * data, size_t length, msgpack::zone& zone){
+            try{
+                std::size_t off = 0;
+                bool referenced = false;
+                obj_ = msgpack::unpack(zone, data, length, off, referenced, [](msgpack::type::object_type, std::size_t, void*){return true;});
+                return obj_;
+            }catch(...){
+                throw std::invalid_argument("unpack failed: invalid request!");
+            }
+        }
+
+        //将msgpack对象转换为指定类型 std::string_view会直接指向对象引用的缓冲区
+        template<typename T>
+        static T as(const msgpack::object& obj){
+            try{
+                return obj.as<T>();
+            }catch(...){
+                throw std::invalid_argument("unpack failed: Args not match!");
+            }
+        }
         private:
             msgpack::unpacked msg_; //反序列化的内容
+            msgpack::object obj_; //反序列化到外部zone时的根对象
 
     };
 }
@@ -3,10 +3,14 @@
 
 #include<iostream>
 #include <memory>
+#include <deque>
+#include <unordered_map>
 #include <boost/asio.hpp>
-#include <boost/asio/deadline_timer.hpp>
 #include "constvars.h"
 #include "router.h"
+#include "io_pool.h"
+#include "buffer_pool.h"
+#include "read_buffer.h"
 
 using namespace std;
 using boost::asio::ip::tcp;
@@ -18,31 +22,66 @@ namespace rpc_server{
 */
 class Connection : public enable_shared_from_this<Connection>{
 private:
+    /*
+    @brief 待发送的回复 [数据长度(4 bytes) 请求id(8 bytes) 数据]
+    */
+    struct message_t{
+        char head[HEAD_LEN];
+        buffer_type data; //来自buffer_pool 发送完成后归还
+    };
+    io_worker& worker_; //连接所在的io线程 用于更新其负载统计
+    boost::asio::io_service& io_service_;
     tcp::socket socket_;
-    char head_[HEAD_LEN];
-    vector<char> body_;
-    uint64_t req_id_;
-    string write_msg_;
-    boost::asio::deadline_timer timer_;
+    read_buffer read_buf_; //读缓冲区 一次读取可包含多个请求
+    deque<message_t> outbox_; //回复队列 按处理完成的先后顺序发送
+    vector<boost::asio::const_buffer> write_buffers_; //合并写的缓冲区列表 复用以避免每次写分配
+    size_t writing_ = 0; //正在发送的消息数
+    size_t outbox_bytes_ = 0; //回复队列中的字节数
+    size_t high_watermark_ = WRITE_HIGH_WATERMARK; //回复队列超过该字节数时暂停读取请求
+    size_t low_watermark_ = WRITE_LOW_WATERMARK; //回复队列回落到该字节数以下时恢复读取
+    bool read_paused_ = false; //是否因回复堆积而暂停读取
+    bool flush_scheduled_ = false; //是否已安排发送 同一轮事件中产生的回复合并成一次写
+    size_t pending_ = 0; //已读取但尚未回复的请求数
+    unordered_map<uint64_t,shared_ptr<stream_state>> streams_; //进行中的流式调用 按请求id接收数据块与额度
+    /*
+    @brief 可取消的请求 带有截止时间的请求同时挂在时间轮上，到期时设置取消标志
+    */
+    struct cancel_entry{
+        cancel_token token;
+        timer_wheel::node timer; //请求带有截止时间时挂在时间轮上 unordered_map中表项的地址不会变化，节点可以内嵌
+    };
+    unordered_map<uint64_t,cancel_entry> cancels_; //尚未回复的可取消请求 按请求id接收取消消息
+    timer_wheel::node timer_; //空闲超时 挂在所属io线程的时间轮上
     size_t timeout_seconds_;
     size_t conn_id = 0;
     atomic_bool has_closed_;//多线程环境下安全处理bool值
+    bool started_ = false; //是否已计入io线程的连接数
+    function<void(int64_t)> close_callback_; //连接关闭时通知服务端注销该连接
 
-    void read_head();
-    void read_body(size_t size);
+    void read();
+    bool parse();
+    bool on_stream_frame(const frame_head& head, const char* body);
+    void cancel(uint64_t req_id);
+    void remove_cancel(unordered_map<uint64_t,cancel_entry>::iterator it);
+    void enqueue(uint64_t req_id, buffer_type && data, frame_type type);
+    void write();
     void reset_timer();
-    void cancel_timer();
+    void on_timeout();
     void close();
 public:
-    Connection(boost::asio::io_service& io_service,std::size_t timeout_seconds);
+    Connection(io_worker& worker,std::size_t timeout_seconds);
     Connection(Connection &) = delete;
     Connection & operator = (Connection &) = delete;
     ~Connection();
     void start();
     tcp::socket & socket();
     bool has_closed() const;
-    void response(string data);
+    void response(uint64_t req_id, buffer_type && data, frame_type type = frame_type::call);
+    void add_stream(uint64_t req_id, shared_ptr<stream_state> stream);
+    cancel_token add_cancel(uint64_t req_id, deadline_type deadline = no_deadline);
     void set_conn_id(int64_t id);
+    void set_close_callback(function<void(int64_t)> callback);
+    void set_watermark(size_t high, size_t low);
     int64_t get_conn_id();
 };
 }
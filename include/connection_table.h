@@ -0,0 +1,36 @@
+#ifndef CONNECTION_TABLE
+#define CONNECTION_TABLE
+
+#include <array>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <boost/noncopyable.hpp>
+
+namespace easy_rpc{
+namespace rpc_server{
+class Connection;
+/*
+@brief 分片的连接表 按连接id分散到多个分片，每个分片各自加锁
+连接id是递增分配的，取模后在各分片间均匀分布，不同连接的注册与注销基本不会竞争同一把锁
+*/
+class connection_table : private boost::noncopyable{
+private:
+    static const size_t shard_count = 32;
+    struct shard{
+        std::mutex mtx;
+        std::unordered_map<int64_t,std::shared_ptr<Connection>> conns;
+    };
+    std::array<shard,shard_count> shards_;
+
+    shard& get_shard(int64_t conn_id);
+public:
+    void add(int64_t conn_id, std::shared_ptr<Connection> conn);
+    void remove(int64_t conn_id);
+    std::shared_ptr<Connection> find(int64_t conn_id);
+    size_t size();
+    void clear();
+};
+}
+}
+#endif
@@ -19,5 +19,10 @@ namespace easy_rpc{
     static const size_t MAX_BUF_LEN = 1048576 * 10;
     static const size_t HEAD_LEN = 12;
     static const size_t INIT_BUF_SIZE = 2*1024;
+    static const size_t MAX_WRITE_FRAMES = 64; //一次写操作最多合并的消息数
+    static const size_t MAX_WRITE_BYTES = 256*1024; //一次写操作最多合并的字节数 单条消息超出时单独发送
+    static const size_t WRITE_HIGH_WATERMARK = 4*1048576; //发送队列超过该字节数时停止读取新请求(服务端)或阻塞新调用(客户端)
+    static const size_t WRITE_LOW_WATERMARK = 1048576; //发送队列回落到该字节数以下时恢复
+    static const size_t STREAM_WINDOW = 16; //流式调用中未被对端消费的块数上限 消费过半后补充额度
 }
 #endif
\ No newline at end of file
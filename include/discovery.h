@@ -0,0 +1,108 @@
+#ifndef DISCOVERY
+#define DISCOVERY
+
+#include <string>
+#include <cstdint>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <memory>
+#include <functional>
+#include <condition_variable>
+
+namespace easy_rpc{
+/*
+@brief 一个服务端地址 以及该服务端提供的服务与当前负载
+*/
+struct endpoint_info{
+    std::string host;
+    unsigned short port = 0;
+    size_t load = 0; //服务端上报的负载 越小越空闲
+    std::vector<std::string> methods; //服务端注册的服务名称
+    int64_t announced_ms = 0; //最近一次注册的时间(系统时钟 毫秒) 由带租约的后端维护
+
+    bool same_address(const endpoint_info& other) const{
+        return host == other.host && port == other.port;
+    }
+};
+/*
+@brief 服务发现接口 服务端通过announce注册/更新自身地址，下线时withdraw；客户端通过lookup查询、watch订阅变化
+service为服务集群的名称，一个集群中的所有服务端提供相同的服务
+*/
+class discovery{
+public:
+    using watcher_type = std::function<void(const std::vector<endpoint_info>&)>;
+    virtual ~discovery() = default;
+    /*
+    @brief 注册或更新服务端 同一地址重复注册时覆盖原有信息
+    */
+    virtual void announce(const std::string& service, const endpoint_info& endpoint) = 0;
+    /*
+    @brief 注销服务端
+    */
+    virtual void withdraw(const std::string& service, const std::string& host, unsigned short port) = 0;
+    /*
+    @brief 查询集群中的全部服务端
+    */
+    virtual std::vector<endpoint_info> lookup(const std::string& service) = 0;
+    /*
+    @brief 订阅集群的变化 地址列表变化时以新的完整列表调用watcher，回调可能在其他线程中执行
+    */
+    virtual void watch(const std::string& service, watcher_type watcher) = 0;
+};
+/*
+@brief 进程内的注册中心 适用于测试或同一进程中的服务端与客户端
+注册信息变化时同步通知订阅者，负载的变化不会触发通知
+*/
+class local_registry : public discovery{
+public:
+    void announce(const std::string& service, const endpoint_info& endpoint) override;
+    void withdraw(const std::string& service, const std::string& host, unsigned short port) override;
+    std::vector<endpoint_info> lookup(const std::string& service) override;
+    void watch(const std::string& service, watcher_type watcher) override;
+private:
+    std::mutex mtx_;
+    std::map<std::string, std::vector<endpoint_info>> services_;
+    std::multimap<std::string, watcher_type> watchers_;
+
+    void notify(const std::string& service, bool changed);
+};
+/*
+@brief 基于本地文件的服务发现 多个进程共享同一个文件
+文件每行一个服务端: service host port load announced_ms method1,method2,...
+写入时持有path.lock上的文件锁，先写临时文件再重命名，读者总能看到完整的文件；后台线程按间隔重新读取文件，地址列表变化时通知订阅者
+注册以租约的方式生效 超过lease_ms未再次announce的服务端视为已下线，异常退出未能withdraw的服务端也会被移除
+*/
+class file_discovery : public discovery{
+public:
+    /*
+    @param path 注册文件路径
+    @param interval_ms 检查文件变化的间隔
+    @param lease_ms 注册的有效期 应为服务端上报间隔的数倍，为0时注册永不过期
+    */
+    explicit file_discovery(const std::string& path, size_t interval_ms = 1000, size_t lease_ms = 15000);
+    ~file_discovery();
+    void announce(const std::string& service, const endpoint_info& endpoint) override;
+    void withdraw(const std::string& service, const std::string& host, unsigned short port) override;
+    std::vector<endpoint_info> lookup(const std::string& service) override;
+    void watch(const std::string& service, watcher_type watcher) override;
+private:
+    using table_type = std::map<std::string, std::vector<endpoint_info>>;
+    std::string path_;
+    size_t interval_ms_;
+    size_t lease_ms_;
+    std::mutex mtx_;
+    std::condition_variable cond_;
+    std::multimap<std::string, watcher_type> watchers_;
+    table_type known_; //上一次通知订阅者时的注册信息
+    bool stop_ = false;
+    std::thread thd_;
+
+    table_type load();
+    void save(const table_type& table);
+    void poll();
+};
+}
+#endif
@@ -0,0 +1,64 @@
+#ifndef FRAME
+#define FRAME
+
+#include <cstdint>
+#include <cstring>
+#include "constvars.h"
+
+namespace easy_rpc{
+/*
+@brief 消息类型 保存在消息头数据长度字段的最高字节中，旧的客户端该字节恒为0，即普通调用
+call: 一次调用 [服务, 参数...]
+batch: 批量调用 [[服务, 参数...], ...] 按顺序执行后在一个回复中返回全部结果 [[结果码, 结果], ...]
+stream_chunk: 流式调用中的一块数据 双向均可发送 请求id为发起流式调用的请求id
+stream_end: 流的结束 服务端发送时为最终结果 [结果码, 结果...]，客户端发送时表示上传结束
+credit: 流量控制 数据为4字节的块数，表示对端还可以再发送多少块
+cancel: 客户端取消请求id对应的调用 没有数据；服务端丢弃尚在排队的调用，正在执行的调用通过cancel_token得知已被取消
+类型字节的最高位为截止时间标志 置位时数据以4字节的剩余时间(毫秒)开头，数据长度包含这4字节
+*/
+enum class frame_type : std::uint8_t{
+    call = 0,
+    batch = 1,
+    stream_chunk = 2,
+    stream_end = 3,
+    credit = 4,
+    cancel = 5,
+};
+static const std::uint32_t FRAME_LEN_MASK = 0x00FFFFFF; //数据长度占用低24位
+static const std::uint8_t FRAME_DEADLINE_FLAG = 0x80; //类型字节中的截止时间标志
+static const std::uint32_t DEADLINE_LEN = sizeof(std::uint32_t); //截止时间的长度 单位毫秒
+static_assert(MAX_BUF_LEN <= FRAME_LEN_MASK, "MAX_BUF_LEN must fit in the frame length field");
+/*
+@brief 消息头 [类型(1 byte)|数据长度(3 bytes) 请求id(8 bytes)]
+*/
+struct frame_head{
+    frame_type type;
+    std::uint32_t body_len;
+    std::uint64_t req_id;
+    bool has_deadline; //数据以剩余时间开头
+};
+/*
+@brief 将消息头写入head 需要HEAD_LEN字节的空间
+@param has_deadline body_len已包含剩余时间的DEADLINE_LEN字节，剩余时间由调用者紧接消息头写入
+*/
+inline void encode_head(char* head, frame_type type, std::uint32_t body_len, std::uint64_t req_id, bool has_deadline = false){
+    std::uint32_t flag = has_deadline ? FRAME_DEADLINE_FLAG : 0;
+    std::uint32_t len = (body_len & FRAME_LEN_MASK) | (((std::uint32_t)type | flag) << 24);
+    memcpy(head, &len, sizeof(std::uint32_t));
+    memcpy(head + sizeof(std::uint32_t), &req_id, sizeof(std::uint64_t));
+}
+/*
+@brief 从head中解析消息头
+*/
+inline frame_head decode_head(const char* head){
+    std::uint32_t len;
+    frame_head h;
+    memcpy(&len, head, sizeof(std::uint32_t));
+    memcpy(&h.req_id, head + sizeof(std::uint32_t), sizeof(std::uint64_t));
+    h.type = (frame_type)((len >> 24) & ~(std::uint32_t)FRAME_DEADLINE_FLAG & 0xFF);
+    h.has_deadline = (len >> 24) & FRAME_DEADLINE_FLAG;
+    h.body_len = len & FRAME_LEN_MASK;
+    return h;
+}
+}
+#endif
@@ -3,25 +3,44 @@
 #include <boost/asio.hpp>
 #include <vector>
 #include <memory>
+#include <atomic>
 #include <boost/noncopyable.hpp>
+#include "timer_wheel.h"
 using namespace std;
 
 namespace easy_rpc{
 namespace rpc_server{
+/*
+@brief io_pool中的一个io线程 包含其io_service以及用于连接分配的负载统计
+*/
+struct io_worker : private boost::noncopyable{
+    boost::asio::io_service io_service; //io_service负责异步操作的事件循环，调度和操作异步循环
+    boost::asio::io_service::work work; //work是辅助类，用于确保io_service在有工作可作时不会退出
+    atomic<size_t> connections{0}; //分配到该线程上的活跃连接数
+    atomic<size_t> pending{0}; //该线程上已读取但尚未回复的请求数
+    atomic<uint64_t> busy_us{0}; //该线程处理单个请求耗时的滑动平均(微秒) 每次解析按本批请求的平均耗时计入一次
+    timer_wheel wheel; //该线程上所有连接共用的时间轮 只能在该线程中访问
+
+    io_worker():work(io_service),wheel(io_service){}
+    size_t load() const;
+    void record_busy(uint64_t us);
+};
+
 class io_pool : private boost::noncopyable{
 private:
-    typedef shared_ptr<boost::asio::io_service> io_service_ptr;  //io_service负责异步操作的事件循环，调度和操作异步循环
-    typedef shared_ptr<boost::asio::io_service::work> work_ptr; //work是辅助类，用于确保io_service在有工作可作时不会退出
-    vector<io_service_ptr> io_services_; //io_services池
-    vector<work_ptr> work_; // 保持io_services运行的work数组
-    size_t next_io_service_;//连接中下一个可使用的io_service
+    typedef shared_ptr<io_worker> io_worker_ptr;
+    vector<io_worker_ptr> workers_; //io线程池
+    size_t next_io_service_;//负载相同时优先选择的io线程 使空闲时的分配保持轮询
 
 public:
     explicit io_pool(size_t pool_size);
     void run();
     void stop();
+    size_t size() const;
+    io_worker & get_worker();
+    io_worker & get_worker(size_t index);
     boost::asio::io_service & get_io_service();
 };
 }
 }
-#endif
\ No newline at end of file
+#endif
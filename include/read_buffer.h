@@ -0,0 +1,95 @@
+#ifndef READ_BUFFER
+#define READ_BUFFER
+
+#include <cstring>
+#include <cstdint>
+#include "constvars.h"
+#include "frame.h"
+#include "block_pool.h"
+
+namespace easy_rpc{
+namespace rpc_server{
+/*
+@brief 连接的读缓冲区 [已消费 | 未解析的数据 | 可写入的空闲空间]
+每次从socket读取尽可能多的数据，一次读取中可能包含多个完整的消息，逐个解析后再继续读取
+剩余的不完整消息在空间不足时搬移到缓冲区头部，单个消息超过容量时换用更大的块
+内存块取自当前线程的block_pool，数据全部解析完后大块立即归还并换回最小的块，不随历史最大请求增长
+*/
+class read_buffer{
+public:
+    read_buffer(){
+        buf_ = block_pool::acquire(block_pool::min_block, capacity_);
+    }
+    ~read_buffer(){
+        clear();
+    }
+    read_buffer(const read_buffer&) = delete;
+    read_buffer& operator=(const read_buffer&) = delete;
+    //未解析数据的起始地址与长度
+    const char* data() const{ return buf_ + begin_; }
+    size_t size() const{ return end_ - begin_; }
+    //可写入的空闲空间
+    char* tail(){ return buf_ + end_; }
+    size_t tail_size() const{ return capacity_ - end_; }
+    //从socket读取了n字节
+    void commit(size_t n){ end_ += n; }
+    //解析完成n字节
+    void consume(size_t n){
+        begin_ += n;
+        if(begin_ != end_) return;
+        //数据全部解析完 直接回到头部 无需搬移
+        begin_ = end_ = 0;
+        if(capacity_ > block_pool::min_block){
+            //大请求已处理完 归还大块
+            block_pool::release(buf_, capacity_);
+            buf_ = block_pool::acquire(block_pool::min_block, capacity_);
+        }
+    }
+    /*
+    @brief 保证缓冲区能容纳长度为n的未解析数据，且尾部至少留有一部分空闲空间用于下一次读取
+    */
+    void reserve(size_t n){
+        if(n < block_pool::min_block) n = block_pool::min_block;
+        if(!buf_){
+            buf_ = block_pool::acquire(n, capacity_);
+            return;
+        }
+        if(capacity_ - begin_ >= n && tail_size() > 0) return;
+        if(capacity_ < n || size() >= capacity_){
+            //换用更大的块 只复制未解析的数据
+            size_t capacity;
+            char* buf = block_pool::acquire(capacity_ < n ? n : capacity_ * 2, capacity);
+            memcpy(buf, data(), size());
+            block_pool::release(buf_, capacity_);
+            buf_ = buf;
+            capacity_ = capacity;
+        }else if(begin_ > 0){
+            memmove(buf_, data(), size());
+        }
+        end_ -= begin_;
+        begin_ = 0;
+    }
+    /*
+    @brief 尝试解析一个消息头 [类型(1 byte)|数据长度(3 bytes) 请求id(8 bytes)]
+    @return 未解析数据不足一个消息头时返回false
+    */
+    bool peek_head(frame_head& head) const{
+        if(size() < HEAD_LEN) return false;
+        head = decode_head(data());
+        return true;
+    }
+    //归还缓冲区内存
+    void clear(){
+        block_pool::release(buf_, capacity_);
+        buf_ = nullptr;
+        capacity_ = begin_ = end_ = 0;
+    }
+private:
+    char* buf_ = nullptr;
+    size_t capacity_ = 0;
+    size_t begin_ = 0;
+    size_t end_ = 0;
+};
+}
+}
+#endif
@@ -0,0 +1,54 @@
+#ifndef REQUEST_ARENA
+#define REQUEST_ARENA
+
+#include <memory_resource>
+#include "codec.h"
+
+namespace easy_rpc{
+namespace rpc_server{
+/*
+@brief 请求内存池 每个线程一个，请求的反序列化对象分配在其中，处理函数也可以用它分配临时对象
+一个请求(或一个批量请求)处理完、结果已打包进回复后整体重置，只保留第一块内存供下一个请求复用
+稳定运行时反序列化不再分配内存；分配的内存只在处理函数调用期间有效，async与stream模式的句柄不能在之后引用它
+例: std::pmr::vector<int> tmp(&request_arena::current());
+*/
+class request_arena : public std::pmr::memory_resource{
+public:
+    static const size_t chunk_size = 64 * 1024; //每块内存的大小 超出时追加新块 重置时释放
+
+    /*
+    @brief 当前线程的请求内存池
+    */
+    static request_arena& current();
+    msgpack::zone& zone(){ return zone_; }
+    /*
+    @brief 请求作用域 最外层的作用域结束时重置内存池 批量请求中的各调用共用一个作用域
+    */
+    class scope{
+    public:
+        scope():arena_(current()){ arena_.depth_++; }
+        ~scope(){
+            if(--arena_.depth_ == 0) arena_.zone_.clear();
+        }
+        scope(const scope&) = delete;
+        scope& operator=(const scope&) = delete;
+        msgpack::zone& zone(){ return arena_.zone_; }
+    private:
+        request_arena& arena_;
+    };
+private:
+    msgpack::zone zone_{chunk_size};
+    size_t depth_ = 0;
+
+    void* do_allocate(size_t bytes, size_t alignment) override{
+        return zone_.allocate_align(bytes, alignment);
+    }
+    //逐个释放无意义 随请求作用域结束整体回收
+    void do_deallocate(void*, size_t, size_t) override{}
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override{
+        return this == &other;
+    }
+};
+}
+}
+#endif
@@ -0,0 +1,73 @@
+#ifndef RESPONSE_HANDLE
+#define RESPONSE_HANDLE
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include "codec.h"
+#include "constvars.h"
+#include "buffer_pool.h"
+#include "call_deadline.h"
+#include "cancel_token.h"
+
+namespace easy_rpc{
+namespace rpc_server{
+class Connection;
+/*
+@brief 延迟回复句柄 记录连接id与请求id，可以被复制并在任意线程、任意时刻完成回复
+句柄只持有连接的weak_ptr，连接关闭或释放后的回复会被直接丢弃，不会访问已销毁的连接
+*/
+class response_handle{
+private:
+    struct state{
+        std::weak_ptr<Connection> conn;
+        int64_t conn_id;
+        uint64_t req_id;
+        deadline_type deadline; //请求的截止时间 句柄在调用处理函数时构造，取自当前请求
+        cancel_token token; //请求的取消标志 同样取自当前请求
+        std::atomic_bool done{false}; //同一请求只允许回复一次
+    };
+    std::shared_ptr<state> state_;
+
+    void send(buffer_type && data) const;
+public:
+    response_handle() = default;
+    response_handle(Connection* conn, uint64_t req_id);
+
+    int64_t conn_id() const;
+    uint64_t req_id() const;
+    /*
+    @brief 连接是否已经关闭或释放 此时的回复将被丢弃
+    */
+    bool expired() const;
+    /*
+    @brief 请求的截止时间与剩余时间 稍后回复的处理函数在其他线程中无法通过call_deadline::current()获取
+    没有截止时间时remaining()为milliseconds::max()，过期后客户端已不再等待回复
+    */
+    deadline_type deadline() const;
+    std::chrono::milliseconds remaining() const;
+    /*
+    @brief 客户端是否已取消该请求、请求已过截止时间或连接已关闭 此时不必再回复
+    */
+    bool cancelled() const;
+    /*
+    @brief 回复成功结果 参数会与result_code::OK一同打包
+    */
+    template<typename... Args>
+    void response(Args&&... args) const{
+        buffer_type buffer = buffer_pool::acquire();
+        msgpack_codec::pack_args_to(buffer, result_code::OK, std::forward<Args>(args)...);
+        send(std::move(buffer));
+    }
+    /*
+    @brief 回复错误信息
+    */
+    void error(const std::string & msg) const{
+        buffer_type buffer = buffer_pool::acquire();
+        msgpack_codec::pack_args_to(buffer, result_code::FAIL, msg);
+        send(std::move(buffer));
+    }
+};
+}
+}
+#endif
@@ -4,12 +4,32 @@
 #include <boost/asio.hpp>
 #include <boost/noncopyable.hpp>
 #include <unordered_map>
+#include <vector>
+#include <algorithm>
 #include "codec.h"
 #include "constvars.h"
 #include "util.h"
+#include "response_handle.h"
+#include "stream_handle.h"
+#include "worker_pool.h"
+#include "buffer_pool.h"
+#include "request_arena.h"
+#include "call_deadline.h"
+#include "cancel_token.h"
 
 namespace easy_rpc{
-enum class ExecMode {sync, async}; //枚举值限定在ExecMode枚举类中，类型安全且有作用域限制
+/*
+sync: 处理函数的返回值即为回复内容
+async: 处理函数以response_handle作为第一个参数，稍后在任意线程中通过句柄回复，Router不再自动回复
+stream: 处理函数以stream_handle作为第一个参数，通过句柄分块收发数据并回复最终结果，总是在io线程中被调用
+枚举值限定在ExecMode枚举类中，类型安全且有作用域限制
+*/
+enum class ExecMode {sync, async, stream};
+/*
+inplace: 处理函数直接在读取请求的io线程中执行，适合耗时很短的处理函数
+offload: 处理函数交给worker_pool执行，避免耗时计算阻塞同一io_service上的其他连接
+*/
+enum class ExecPolicy {inplace, offload};
 namespace rpc_server{
 class Connection;
 /*
@@ -17,122 +37,365 @@ class Connection;
 */
 class Router{
 private:
-    std::unordered_map<std::string,std::function<void(Connection*,const char*,size_t,std::string &,ExecMode&)>> map_invlkers_;//rpc请求的处理回调函数
-    std::function<void(const std::string&,std::string &&,Connection*,bool)> callback_to_server_;
+    /*
+    调用函数 由invoker模板为每个处理函数生成一个普通函数 ctx指向保存的处理函数对象
+    结果直接打包进result 返回false表示解码失败或处理函数抛出异常 此时result中为错误信息
+    */
+    typedef bool(*invoke_fn)(const void* ctx,Connection*,uint64_t,const msgpack::object&,buffer_type& result);
+    struct handler_t{
+        invoke_fn invoke;
+        std::shared_ptr<void> ctx; //处理函数对象 成员函数还包括调用对象
+        ExecMode mode;
+        ExecPolicy policy;
+        uint32_t id; //服务id 由服务名称计算
+        std::string name;
+    };
+    std::unordered_map<std::string,handler_t> map_invlkers_;//rpc请求的处理回调函数 按名称查找仅作为兼容
+    std::vector<handler_t*> id_table_; //按服务id索引的完美哈希表 槽位为(id * id_seed_) >> id_shift_
+    uint32_t id_seed_ = 1;
+    uint32_t id_shift_ = 32;
+    std::function<void(std::string_view,buffer_type &&,Connection*,uint64_t,bool)> callback_to_server_;
+    worker_pool* worker_pool_ = nullptr; //offload模式的处理函数在此执行 为空时退化为inplace
     
     Router(){};
     Router(Router &) = delete;
     Router & operator = (Router &) = delete;
 
+    /*
+    @brief 构造处理函数的第一个参数 处理函数可以声明为Connection*，也可以声明为response_handle以便延迟回复，或声明为stream_handle进行流式调用
+    */
+    template<typename First>
+    static typename std::enable_if<std::is_same<remove_const_reference_t<First>,response_handle>::value,response_handle>::type
+    first_arg(Connection* conn, uint64_t req_id){
+        return response_handle(conn, req_id);
+    }
+
+    template<typename First>
+    static typename std::enable_if<std::is_same<remove_const_reference_t<First>,stream_handle>::value,stream_handle>::type
+    first_arg(Connection* conn, uint64_t req_id){
+        return stream_handle(conn, req_id);
+    }
+
+    template<typename First>
+    static typename std::enable_if<!std::is_same<remove_const_reference_t<First>,response_handle>::value &&
+        !std::is_same<remove_const_reference_t<First>,stream_handle>::value,Connection*>::type
+    first_arg(Connection* conn, uint64_t){
+        return conn;
+    }
+
     /*
     @brief 非成员函数调用器  
     */
-    template<typename F, size_t ... I,typename Arg,typename ... Args>
-    static typename std::result_of<F(Connection*,Args...)>::type 
-    call_helper(const F& f,const std::index_sequence<I...>&,const std::tuple<Arg,Args...>& tup,Connection *ptr){
-        return f(ptr, std::get<I+1>(tup)...);
+    template<typename F, typename First, size_t ... I,typename Arg,typename ... Args>
+    static typename std::result_of<F(First,Args...)>::type 
+    call_helper(const F& f,const std::index_sequence<I...>&,const std::tuple<Arg,Args...>& tup,First first){
+        return f(first, std::get<I+1>(tup)...);
     }
     /*
     @brief 函数调用 F返回结果为空时有效
     */
-    template<typename F,typename Arg,typename... Args>
-    static typename std::enable_if<std::is_void<typename std::result_of<F(Connection*,Args...)>::type>::value>::type 
-    call(const F& f,Connection* ptr,std::string& result,std::tuple<Arg,Args...>& tp){
-        call_helper(f,std::make_index_sequence<sizeof...(Args)>{},tp,ptr);
-        result = msgpack_codec::pack_args_str(result_code::OK);
+    template<typename F,typename First,typename Arg,typename... Args>
+    static typename std::enable_if<std::is_void<typename std::result_of<F(First,Args...)>::type>::value>::type 
+    call(const F& f,First first,buffer_type& result,std::tuple<Arg,Args...>& tp){
+        call_helper(f,std::make_index_sequence<sizeof...(Args)>{},tp,first);
+        msgpack_codec::pack_args_to(result,result_code::OK);
     }
 
     //F返回结果为不为空时有效
-    template<typename F,typename Arg,typename... Args>
-    static typename std::enable_if<!std::is_void<typename std::result_of<F(Connection *, Args...)>::type>::value>::type
-    call(const F& f,Connection* ptr,std::string& result,std::tuple<Arg,Args...>& tp){
-        auto r = call_helper(f,std::make_index_sequence<sizeof...(Args)>{},tp,ptr);
-        result = msgpack_codec::pack_args_str(result_code::OK,r);
+    template<typename F,typename First,typename Arg,typename... Args>
+    static typename std::enable_if<!std::is_void<typename std::result_of<F(First, Args...)>::type>::value>::type
+    call(const F& f,First first,buffer_type& result,std::tuple<Arg,Args...>& tp){
+        auto r = call_helper(f,std::make_index_sequence<sizeof...(Args)>{},tp,first);
+        msgpack_codec::pack_args_to(result,result_code::OK,r);
     }
     /*
     @brief 成员函数调用器
     */
-    template<typename F,typename Self,size_t... Indexes, typename Arg,typename... Args>
-    static typename std::result_of<F(Self,Connection*,Args...)>::type 
-    call_member_helper(const F & f, Self * self,const std::index_sequence<Indexes...>&,const std::tuple<Arg,Args...>& tup,Connection* ptr){
-        return (*self.*f)(ptr,std::get<Indexes+1>(tup)...);
+    template<typename F,typename Self,typename First,size_t... Indexes, typename Arg,typename... Args>
+    static typename std::result_of<F(Self,First,Args...)>::type 
+    call_member_helper(const F & f, Self * self,const std::index_sequence<Indexes...>&,const std::tuple<Arg,Args...>& tup,First first){
+        return (*self.*f)(first,std::get<Indexes+1>(tup)...);
     }
     /*
     @brief 成员函数调用 调用函数返回为空的成员函数
     */
-    template<typename F,typename Self, typename Arg,typename... Args>
-    typename std::enable_if<std::is_void<typename std::result_of<F(Self,Connection*,Args...)>::type>::value>::type
-    static call_member(const F& f,Self* self,Connection* ptr,std::string &result,const std::tuple<Arg,Args...>& tp){
-        call_member(f,self,typename std::make_index_sequence<sizeof...(Args)>{},tp,ptr);
-        result = msgpack_codec::pack_args_str(result_code::OK);
+    template<typename F,typename Self,typename First, typename Arg,typename... Args>
+    typename std::enable_if<std::is_void<typename std::result_of<F(Self,First,Args...)>::type>::value>::type
+    static call_member(const F& f,Self* self,First first,buffer_type &result,const std::tuple<Arg,Args...>& tp){
+        call_member_helper(f,self,typename std::make_index_sequence<sizeof...(Args)>{},tp,first);
+        msgpack_codec::pack_args_to(result,result_code::OK);
     }
     /*
     @brief 成员函数调用 调用函数返回不为空的成员函数
     */
-    template<typename F,typename Self, typename Arg,typename... Args>
-    static typename std::enable_if<!std::is_void<typename std::result_of<F(Self,Connection*,Args...)>::type>::value>::type
-    call_member(const F& f,Self* self,Connection* ptr,std::string &result,const std::tuple<Arg,Args...>& tp){
-        auto r = call_member_helper(f,self,typename std::make_index_sequence<sizeof...(Args)>{}, tp, ptr);
-        result = msgpack_codec::pack_args_str(result_code::OK,r);
+    template<typename F,typename Self,typename First, typename Arg,typename... Args>
+    static typename std::enable_if<!std::is_void<typename std::result_of<F(Self,First,Args...)>::type>::value>::type
+    call_member(const F& f,Self* self,First first,buffer_type &result,const std::tuple<Arg,Args...>& tp){
+        auto r = call_member_helper(f,self,typename std::make_index_sequence<sizeof...(Args)>{}, tp, first);
+        msgpack_codec::pack_args_to(result,result_code::OK,r);
     }
     /*
     @brief 注册一个非成员函数的服务
     */
-    template<ExecMode model,typename Function>
+    template<ExecMode model,ExecPolicy policy,typename Function>
     void register_nonmember_func(std::string const & name,Function f){
-        map_invlkers_[name] = {
-            //一个新的可调用对象，其函数来自结构体模板中的静态成员函数模板 且固定函数指针  后续调用需要传入其余参数
-            std::bind(&invoker<Function>::template apply<model>,std::move(f),std::placeholders::_1,
-                std::placeholders::_2,std::placeholders::_3,std::placeholders::_4,std::placeholders::_5)
-        };
+        //保存处理函数对象 调用时由编译期生成的invoker<Function>::apply直接转换回原类型 不经过std::bind与std::function
+        add_handler(name,&invoker<Function>::apply,std::make_shared<Function>(std::move(f)),model,policy);
     }
     /*
     @brief 注册一个成员函数格式的服务
     */
-    template<ExecMode model,typename Function, typename Self>
+    template<ExecMode model,ExecPolicy policy,typename Function, typename Self>
     void register_member_func(const std::string& name,const Function& f, Self* self){
-        map_invlkers_[name] = {std::bind(&invoker<Function>::template apply_member<model, Self>,f,self,std::placeholders::_1,std::placeholders::_2,std::placeholders::_3,std::placeholders::_4,std::placeholders::_5)};
+        using member_t = typename invoker<Function>::template member<Self>;
+        add_handler(name,&invoker<Function>::template apply_member<Self>,std::make_shared<member_t>(member_t{f,self}),model,policy);
+    }
+    /*
+    @brief 保存服务并重建服务id的索引表 不同名称的服务id冲突时拒绝注册
+    */
+    void add_handler(const std::string& name, invoke_fn invoke, std::shared_ptr<void> ctx, ExecMode mode, ExecPolicy policy){
+        uint32_t id = method_id(name);
+        for(auto &kv : map_invlkers_){
+            if(kv.second.id == id && kv.first != name){
+                throw std::logic_error("method id of " + name + " conflicts with " + kv.first);
+            }
+        }
+        map_invlkers_[name] = {invoke, std::move(ctx), mode, policy, id, name};
+        rebuild_id_table();
+    }
+    /*
+    @brief 为当前所有服务id寻找无冲突的乘数与表长 得到一个完美哈希表
+    服务数量很少且只在注册时重建 查找时只需一次乘法、一次移位和一次比较
+    */
+    void rebuild_id_table(){
+        size_t bits = 0;
+        while(((size_t)1 << bits) < map_invlkers_.size() * 2) bits++;
+        for(;; bits++){
+            std::vector<handler_t*> table((size_t)1 << bits, nullptr);
+            uint32_t shift = 32 - (uint32_t)bits;
+            for(uint32_t seed = 2654435761u, tries = 0; tries < 64; seed += 0x9e3779b9u * 2, tries++){
+                std::fill(table.begin(), table.end(), nullptr);
+                bool ok = true;
+                for(auto &kv : map_invlkers_){
+                    size_t slot = bits == 0 ? 0 : (uint32_t)(kv.second.id * seed) >> shift;
+                    if(table[slot]){
+                        ok = false;
+                        break;
+                    }
+                    table[slot] = &kv.second;
+                }
+                if(ok){
+                    id_table_.swap(table);
+                    id_seed_ = seed;
+                    id_shift_ = shift;
+                    return;
+                }
+            }
+        }
+    }
+    /*
+    @brief 按服务id查找服务 不存在时返回空
+    */
+    handler_t* find_handler(uint32_t id){
+        if(id_table_.empty()) return nullptr;
+        size_t slot = id_shift_ >= 32 ? 0 : (uint32_t)(id * id_seed_) >> id_shift_;
+        handler_t* handler = id_table_[slot];
+        return handler && handler->id == id ? handler : nullptr;
+    }
+    /*
+    @brief 按服务名称查找服务 借用线程内的字符串作为查找键 避免每次请求分配内存
+    */
+    handler_t* find_handler(std::string_view name){
+        thread_local std::string key;
+        key.assign(name.data(), name.size());
+        auto it = map_invlkers_.find(key);
+        return it == map_invlkers_.end() ? nullptr : &it->second;
+    }
+
+    /*
+    @brief 查找请求对应的服务 请求格式为[服务id或服务名称(兼容按名称调用的客户端), 参数...]
+    @param func_name 服务不存在时保存请求的服务 用于错误信息
+    @return 服务不存在时返回空
+    */
+    handler_t* resolve(const msgpack::object& req, std::string& func_name){
+        if(req.type != msgpack::type::ARRAY || req.via.array.size == 0){
+            throw std::invalid_argument("invalid request: function name is missing");
+        }
+        const msgpack::object& method = req.via.array.ptr[0];
+        if(method.type == msgpack::type::POSITIVE_INTEGER){
+            handler_t* found = find_handler(msgpack_codec::as<uint32_t>(method));
+            if(!found) func_name = "#" + std::to_string(method.via.u64);
+            return found;
+        }
+        std::string_view name = msgpack_codec::as<std::string_view>(method);
+        handler_t* found = find_handler(name);
+        if(!found) func_name = std::string(name);
+        return found;
     }
 
     /*
-    @brief 对参数进行解码并处理函数调用
+    @brief 请求的解码类型 第一个元素为服务id或服务名称 不关心其类型 只保留引用
     */
-    template<typename Function, ExecMode mode = ExecMode::sync>
+    template<typename Tuple>
+    struct request_tuple;
+
+    template<typename... Args>
+    struct request_tuple<std::tuple<Args...>>{
+        using type = std::tuple<msgpack::object, Args...>;
+    };
+
+    /*
+    @brief 对参数进行解码并处理函数调用 每个处理函数类型生成各自的调用函数
+    */
+    template<typename Function>
     struct invoker{
-        //调用非成员函数 内联函数将在调用时展开为函数代码 避免了函数压栈 减小计算
-        template<ExecMode model>
-        static inline void apply(const Function& func,Connection* conn, const char* data,size_t size,std::string& result, ExecMode& exe_model){
-            using args_tuple = typename function_traits<Function>::args_tuple_2nd;
-            exe_model = ExecMode::sync;
-            msgpack_codec codec;
+        //成员函数及其调用对象
+        template<typename Self>
+        struct member{
+            Function func;
+            Self* self;
+        };
+        //调用非成员函数
+        static bool apply(const void* ctx,Connection* conn,uint64_t req_id,const msgpack::object& args,buffer_type& result){
+            using args_tuple = typename request_tuple<typename function_traits<Function>::args_tuple_2nd>::type;
+            using first_type = typename function_traits<Function>::first_arg_type;
+            const Function& func = *static_cast<const Function*>(ctx);
             try{
-                auto tp = codec.unpack<args_tuple>(data,size);
-                call(func,conn,result,tp);
-                exe_model = model;
-            }catch(std::invalid_argument & e){
-                result = codec.pack_args_str(result_code::FAIL,e.what());
+                auto tp = msgpack_codec::as<args_tuple>(args);
+                call(func,first_arg<first_type>(conn,req_id),result,tp);
+                return true;
             }catch(const std::exception & e){
-                result = codec.pack_args_str(result_code::FAIL,e.what());
+                result.clear();
+                msgpack_codec::pack_args_to(result,result_code::FAIL,e.what());
+                return false;
             }
         }
         //调用成员函数
-        template<ExecMode model,typename Self>
-        static inline void apply_member(const Function& func,Self *self,Connection* conn,const char *data, size_t size,std::string& result,ExecMode& exe_model){
-            using arg_tuple = typename function_traits<Function>::args_tuple_2nd;
-            exe_model = ExecMode::sync;
-            msgpack_codec codec;
+        template<typename Self>
+        static bool apply_member(const void* ctx,Connection* conn,uint64_t req_id,const msgpack::object& args,buffer_type& result){
+            using arg_tuple = typename request_tuple<typename function_traits<Function>::args_tuple_2nd>::type;
+            using first_type = typename function_traits<Function>::first_arg_type;
+            const member<Self>& m = *static_cast<const member<Self>*>(ctx);
             try{
-                auto tp = codec.unpack<arg_tuple>(data,size);
-                call_member(func, self, conn, result, tp);
-                exe_model = model;
-            }catch(std::invalid_argument & e){
-                result = codec.pack_args_str(result_code::FAIL,e.what());
-            }catch(std::exception &e){
-                result = codec.pack_args_str(result_code::FAIL,e.what());
+                auto tp = msgpack_codec::as<arg_tuple>(args);
+                call_member(m.func, m.self, first_arg<first_type>(conn,req_id), result, tp);
+                return true;
+            }catch(const std::exception & e){
+                result.clear();
+                msgpack_codec::pack_args_to(result,result_code::FAIL,e.what());
+                return false;
             }
         }
     };
+
+    /*
+    @brief 调用处理函数 同步模式或调用失败时将结果回调给服务端
+    */
+    template<typename T>
+    void invoke(const handler_t& handler,std::string_view func_name,const msgpack::object& args,T conn,uint64_t req_id){
+        //结果直接打包进缓冲池中的buffer 之后原样交给连接发送
+        buffer_type result = buffer_pool::acquire();
+        bool ok = handler.invoke(handler.ctx.get(),conn,req_id,args,result);
+        if((!ok || handler.mode == ExecMode::sync) && callback_to_server_){
+            //回复数据过长
+            if(result.size() >= MAX_BUF_LEN){
+                buffer_pool::release(std::move(result));
+                fail(func_name,"The response result is out of range." + std::string(func_name),conn,req_id);
+            }else{
+                //正常回调
+                callback_to_server_(func_name,std::move(result),conn,req_id,!ok);
+            }
+        }else{
+            buffer_pool::release(std::move(result));
+        }
+    }
+    /*
+    @brief 回复错误信息
+    */
+    template<typename T>
+    void fail(std::string_view func_name,const std::string& msg,T conn,uint64_t req_id){
+        if(!callback_to_server_) return;
+        buffer_type result = buffer_pool::acquire();
+        msgpack_codec::pack_args_to(result,result_code::FAIL,msg);
+        callback_to_server_(func_name,std::move(result),conn,req_id,true);
+    }
+    /*
+    @brief 批量调用中是否存在offload模式的服务
+    */
+    bool has_offload(const msgpack::object& req){
+        for(uint32_t i = 0; i < req.via.array.size; i++){
+            const msgpack::object& entry = req.via.array.ptr[i];
+            if(entry.type != msgpack::type::ARRAY || entry.via.array.size == 0) continue;
+            const msgpack::object& method = entry.via.array.ptr[0];
+            handler_t* found = method.type == msgpack::type::POSITIVE_INTEGER ? find_handler((uint32_t)method.via.u64) :
+                method.type == msgpack::type::STR ? find_handler(std::string_view(method.via.str.ptr,method.via.str.size)) : nullptr;
+            if(found && found->policy == ExecPolicy::offload) return true;
+        }
+        return false;
+    }
+    /*
+    @brief 依次执行批量中的每个调用 各调用的结果先打包到临时buffer 再追加到回复中
+    批量的截止时间已过或已被取消后，剩余调用的结果为[FAIL, "deadline exceeded"/"cancelled"]
+    */
+    template<typename T>
+    void invoke_batch(const msgpack::object& req, T conn, uint64_t req_id){
+        buffer_type result = buffer_pool::acquire();
+        buffer_type entry = buffer_pool::acquire();
+        msgpack::packer<buffer_type> pk(result);
+        pk.pack_array(req.via.array.size);
+        deadline_type deadline = call_deadline::current();
+        cancel_token token = cancel_token::current();
+        for(uint32_t i = 0; i < req.via.array.size; i++){
+            entry.clear();
+            //每个调用之前检查 调用方已经超时或取消时剩余的调用不再执行
+            if(call_deadline::expired(deadline)){
+                msgpack_codec::pack_args_to(entry,result_code::FAIL,"deadline exceeded");
+            }else if(token.cancelled()){
+                msgpack_codec::pack_args_to(entry,result_code::FAIL,"cancelled");
+            }else{
+                invoke_entry(req.via.array.ptr[i],conn,req_id,entry);
+            }
+            result.write(entry.data(),entry.size());
+        }
+        buffer_pool::release(std::move(entry));
+        if(result.size() >= MAX_BUF_LEN){
+            buffer_pool::release(std::move(result));
+            fail("","The response result is out of range.",conn,req_id);
+            return;
+        }
+        if(callback_to_server_){
+            callback_to_server_("",std::move(result),conn,req_id,false);
+        }else{
+            buffer_pool::release(std::move(result));
+        }
+    }
+    /*
+    @brief 执行批量中的一个调用 失败时result中为[FAIL, 错误信息]
+    async与stream模式的服务需要通过句柄自行回复 不能出现在批量调用中
+    */
+    template<typename T>
+    void invoke_entry(const msgpack::object& req, T conn, uint64_t req_id, buffer_type& result){
+        try{
+            std::string func_name;
+            handler_t* found = resolve(req,func_name);
+            if(!found){
+                msgpack_codec::pack_args_to(result,result_code::FAIL,"unknown funciton: " + func_name);
+            }else if(found->mode != ExecMode::sync){
+                msgpack_codec::pack_args_to(result,result_code::FAIL,"only sync function can be batched: " + found->name);
+            }else{
+                found->invoke(found->ctx.get(),conn,req_id,req,result);
+            }
+        }catch(const std::exception & ex){
+            result.clear();
+            msgpack_codec::pack_args_to(result,result_code::FAIL,ex.what());
+        }
+    }
 public:
+    /*
+    @brief 处理函数类型对应的调用函数 注册时存入服务表，对外公开供基准测试直接调用
+    */
+    template<typename Function>
+    using invoker_of = invoker<Function>;
     /*
     @brief 单例模式 获取Router对象
     */
@@ -146,9 +409,9 @@ public:
     @param name 服务名称
     @param f 处理函数
     */
-    template<ExecMode model, typename Function>
+    template<ExecMode model, ExecPolicy policy = ExecPolicy::inplace, typename Function>
     void register_handler(std::string const & name, Function &f){
-        return register_nonmember_func<model> (name, move(f));
+        return register_nonmember_func<model,policy> (name, std::move(f));
     }
 
     /*
@@ -157,9 +420,9 @@ public:
     @param f 处理函数
     @param self 调用对象
     */
-    template<ExecMode model, typename Function, typename Self>
+    template<ExecMode model, ExecPolicy policy = ExecPolicy::inplace, typename Function, typename Self>
     void register_handler(std::string const & name, Function &f, Self* self){
-        return register_member_func<model>(name,f,self);
+        return register_member_func<model,policy>(name,f,self);
     }
     /*
     @brief 移除特定服务
@@ -167,54 +430,158 @@ public:
     */
     void remove_handler(std::string const & name){
         map_invlkers_.erase(name);
+        rebuild_id_table();
+    }
+    /*
+    @brief 已注册的全部服务名称 用于向服务发现注册
+    */
+    std::vector<std::string> handler_names() const{
+        std::vector<std::string> names;
+        for(auto &kv : map_invlkers_) names.push_back(kv.first);
+        return names;
     }
     /*
     @brief 设定router当前的回调函数
     @param callback 回调函数
     */
-    void set_callback(const std::function<void(const std::string&,std::string &&,Connection*,bool)> &callback){
+    void set_callback(const std::function<void(std::string_view,buffer_type &&,Connection*,uint64_t,bool)> &callback){
         callback_to_server_ = callback;
     }
     /*
+    @brief 设定执行offload模式处理函数的线程池
+    @param pool 线程池 为空时所有处理函数都在io线程中执行
+    */
+    void set_worker_pool(worker_pool* pool){
+        worker_pool_ = pool;
+    }
+    /*
     @brief 根据传入的请求数据，确定需要调用的服务，调用服务并返回结果
-    @param data 传入的请求体数据,往往是被序列化过的数据
+    @param data 传入的请求体数据,往往是被序列化过的数据 处理函数中string_view类型的参数直接指向该缓冲区，仅在处理函数调用期间有效
     @param size 请求数据大小
     @param conn 连接
+    @param req_id 请求id 回复时原样带回，客户端据此匹配乱序到达的回复
+    @param deadline 请求的截止时间 过期的请求不再执行，直接回复错误；处理函数可通过call_deadline查询剩余时间
     */
     template<typename T>
-    void route(const char* data, std::size_t size, T conn){
-        std::string result;
+    void route(const char* data, std::size_t size, T conn, uint64_t req_id, deadline_type deadline = no_deadline){
+        if(call_deadline::expired(deadline)){
+            //调用者已经放弃等待 不再解码与执行
+            fail("","deadline exceeded",conn,req_id);
+            return;
+        }
         try{
             msgpack_codec codec;
-            //反序列化 获取原始请求
-            auto p = codec.unpack<std::tuple<std::string>>(data,size);
-            //获取p中第一个元素 函数名字
-            auto &func_name = std::get<0>(p);
-            //查看服务列表中是否有请求的服务
-            auto it = map_invlkers_.find(func_name);
-            if(it == map_invlkers_.end()){ //服务不存在
-                result = codec.pack_args_str(result_code::FAIL,"unknown funciton: " + func_name);
-                callback_to_server_(func_name, std::move(result),conn,true);
+            //只反序列化一次 得到的对象直接引用请求缓冲区 函数名与string_view类型的参数都不复制
+            //对象分配在线程的请求内存池中 处理完成后整体重置
+            request_arena::scope arena;
+            const msgpack::object& req = codec.unpack_ref(data,size,arena.zone());
+            std::string func_name;
+            handler_t* found = resolve(req,func_name);
+            if(!found){ //服务不存在
+                fail(func_name,"unknown funciton: " + func_name,conn,req_id);
                 return;
             }
-            ExecMode model;
-            //调用函数并将结果和调用模式写入result和model中
-            it->second(conn,data,size,result,model);
-            if(model == ExecMode::sync && callback_to_server_){
-                //回复数据过长
-                if(result.size() >= MAX_BUF_LEN){
-                    result = codec.pack_args_str(result_code::FAIL,"The response result is out of range." + func_name);
-                    callback_to_server_(func_name,std::move(result),conn,true);
-                    return;
-                }else{
-                    //正常回调
-                    callback_to_server_(func_name, std::move(result),conn,false);
+            auto &handler = *found;
+            //流式调用的句柄需要在io线程中登记到连接上 不交给worker_pool 由处理函数自行安排读写线程
+            bool offload = handler.policy == ExecPolicy::offload && worker_pool_ && handler.mode != ExecMode::stream;
+            //排队执行或稍后回复的请求可以被客户端取消 其余请求在取消消息到达之前已经处理完成
+            cancel_token token = offload || handler.mode == ExecMode::async ? conn->add_cancel(req_id,deadline) : cancel_token();
+            if(offload){
+                //请求体所在的缓冲区会被下一个请求复用 交给工作线程前复制一份 并持有连接防止其提前释放
+                //请求体的复制与任务对象仍会分配内存，offload路径只有回复buffer经缓冲区池复用
+                auto self = conn->shared_from_this();
+                auto task = [this,&handler,self,req_id,deadline,token,body = std::string(data,size)]{
+                    //在线程池中排队期间可能已经过期或被取消
+                    if(call_deadline::expired(deadline)){
+                        fail(handler.name,"deadline exceeded: " + handler.name,self.get(),req_id);
+                        return;
+                    }
+                    if(token.cancelled()){
+                        fail(handler.name,"cancelled: " + handler.name,self.get(),req_id);
+                        return;
+                    }
+                    msgpack_codec codec;
+                    try{
+                        call_deadline::scope in_deadline(deadline);
+                        cancel_token::scope in_cancel(token);
+                        request_arena::scope arena;
+                        const msgpack::object& req = codec.unpack_ref(body.data(),body.size(),arena.zone());
+                        invoke(handler,handler.name,req,self.get(),req_id);
+                    }catch(const std::exception & ex){
+                        fail("",ex.what(),self.get(),req_id);
+                    }
+                };
+                auto reject = [this,&handler,self,req_id]{
+                    fail(handler.name,"server stopping: " + handler.name,self.get(),req_id);
+                };
+                if(!worker_pool_->try_post(std::move(task),std::move(reject))){
+                    fail(handler.name,"server busy: " + handler.name,conn,req_id);
                 }
+                return;
             }
+            call_deadline::scope in_deadline(deadline);
+            cancel_token::scope in_cancel(token);
+            invoke(handler,handler.name,req,conn,req_id);
         }catch(const std::exception & ex){
+            fail("",ex.what(),conn,req_id);
+        }
+    }
+    /*
+    @brief 批量调用 请求体为[[服务, 参数...], ...]，按顺序执行每个调用，全部结果合并为一个回复[[结果码, 结果], ...]
+    单个调用失败只影响其对应的结果；批量中存在offload模式的服务时整批交给worker_pool执行
+    @param data 请求体数据 与route相同，string_view类型的参数仅在处理函数调用期间有效
+    @param size 请求数据大小
+    @param conn 连接
+    @param req_id 请求id 整个批量调用只有一个回复
+    @param deadline 整个批量调用的截止时间
+    */
+    template<typename T>
+    void route_batch(const char* data, std::size_t size, T conn, uint64_t req_id, deadline_type deadline = no_deadline){
+        if(call_deadline::expired(deadline)){
+            fail("","deadline exceeded",conn,req_id);
+            return;
+        }
+        try{
             msgpack_codec codec;
-            result = codec.pack_args_str(result_code::FAIL,ex.what());
-            callback_to_server_("",std::move(result),conn,true);
+            request_arena::scope arena;
+            const msgpack::object& req = codec.unpack_ref(data,size,arena.zone());
+            if(req.type != msgpack::type::ARRAY){
+                throw std::invalid_argument("invalid batch request");
+            }
+            if(worker_pool_ && has_offload(req)){
+                auto self = conn->shared_from_this();
+                cancel_token token = conn->add_cancel(req_id,deadline);
+                auto task = [this,self,req_id,deadline,token,body = std::string(data,size)]{
+                    if(call_deadline::expired(deadline)){
+                        fail("","deadline exceeded",self.get(),req_id);
+                        return;
+                    }
+                    if(token.cancelled()){
+                        fail("","cancelled",self.get(),req_id);
+                        return;
+                    }
+                    msgpack_codec codec;
+                    try{
+                        call_deadline::scope in_deadline(deadline);
+                        cancel_token::scope in_cancel(token);
+                        request_arena::scope arena;
+                        invoke_batch(codec.unpack_ref(body.data(),body.size(),arena.zone()),self.get(),req_id);
+                    }catch(const std::exception & ex){
+                        fail("",ex.what(),self.get(),req_id);
+                    }
+                };
+                auto reject = [this,self,req_id]{
+                    fail("","server stopping: batch",self.get(),req_id);
+                };
+                if(!worker_pool_->try_post(std::move(task),std::move(reject))){
+                    fail("","server busy: batch",conn,req_id);
+                }
+                return;
+            }
+            call_deadline::scope in_deadline(deadline);
+            invoke_batch(req,conn,req_id);
+        }catch(const std::exception & ex){
+            fail("",ex.what(),conn,req_id);
         }
     }
 
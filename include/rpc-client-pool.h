@@ -0,0 +1,254 @@
+#ifndef RPC_CLIENT_POOL_HPP
+#define RPC_CLIENT_POOL_HPP
+#include <random>
+#include <thread>
+#include "rpc-client.h"
+#include "io_pool.h"
+#include "discovery.h"
+
+namespace easy_rpc{
+    /*
+    @brief 负载均衡策略
+    least_outstanding: 选择未完成请求最少的连接 每次选择遍历全部连接
+    power_of_two: 随机取两个连接选择其中未完成请求较少的一个 开销固定且避免所有调用同时涌向同一个连接
+    */
+    enum class balance_policy {least_outstanding, power_of_two};
+    /*
+    @brief 客户端连接池 对多个服务端地址各建立若干连接，所有连接共用一组io线程
+    每次调用按负载均衡策略选择一个已连接的连接，接口与rpc_client相同
+    pick返回的连接与start_call返回的pending_call可以比连接池存活更久：每个连接共同持有io线程池，连接池析构后它们已停止，调用立即失败
+    服务端地址可以手动添加，也可以通过服务发现订阅，地址变化时只为新增地址建立连接、关闭已下线地址的连接，其余连接不受影响
+    */
+    class rpc_client_pool:private boost::noncopyable{
+    private:
+        using client_ptr = std::shared_ptr<rpc_client>;
+        using client_list = std::vector<client_ptr>;
+        std::shared_ptr<rpc_server::io_pool> io_pool_; //所有连接共用的io线程 由连接共同持有，io服务在最后一个连接释放后才析构
+        std::shared_ptr<std::thread> thd_;
+        std::shared_ptr<const client_list> clients_; //当前的连接列表 更新时整体替换，选择连接时无需加锁
+        client_list retired_; //已下线地址的连接 已停止但可能仍被调用者持有，不再被引用后释放
+        std::mutex mtx_; //保护连接列表的更新
+        size_t next_io_ = 0;
+        balance_policy policy_;
+        size_t connect_timeout = 2;
+        size_t wait_timeout = 2;
+        size_t connections_per_endpoint_ = 1; //服务发现的每个地址建立的连接数
+        std::shared_ptr<discovery> discovery_;
+        /*
+        @brief 服务发现回调持有的连接池引用 服务发现可能比连接池存活更久，连接池停止后回调不再访问连接池
+        */
+        struct watch_state{
+            std::mutex mtx;
+            rpc_client_pool* pool;
+        };
+        std::shared_ptr<watch_state> watch_state_;
+
+        std::shared_ptr<const client_list> snapshot() const{
+            return std::atomic_load(&clients_);
+        }
+        client_ptr make_client(const std::string & host, unsigned short port){
+            auto &ios = io_pool_->get_worker(next_io_++ % io_pool_->size()).io_service;
+            auto client = std::make_shared<rpc_client>(ios, host, port, io_pool_);
+            client->set_connect_timeout(connect_timeout);
+            client->set_wait_timeout(wait_timeout);
+            return client;
+        }
+        /*
+        @brief 按服务发现给出的地址列表更新连接 新地址建立连接并异步连接，已下线地址的连接关闭
+        */
+        void update_endpoints(const std::vector<endpoint_info>& endpoints){
+            std::lock_guard<std::mutex> lock(mtx_);
+            //释放已不被调用者持有的下线连接 停止时未完成的请求已全部结束
+            retired_.erase(std::remove_if(retired_.begin(), retired_.end(), [](const client_ptr& client){
+                return client.use_count() == 1 && client->outstanding() == 0;
+            }), retired_.end());
+            auto old_list = snapshot();
+            auto new_list = std::make_shared<client_list>();
+            client_list added;
+            for(auto &client : *old_list){
+                bool alive = std::any_of(endpoints.begin(), endpoints.end(), [&client](const endpoint_info& e){
+                    return client->host() == e.host && client->port() == e.port;
+                });
+                if(alive){
+                    new_list->push_back(client);
+                }else{
+                    client->stop();
+                    retired_.push_back(client);
+                }
+            }
+            for(auto &e : endpoints){
+                bool known = std::any_of(old_list->begin(), old_list->end(), [&e](const client_ptr& c){
+                    return c->host() == e.host && c->port() == e.port;
+                });
+                if(known) continue;
+                for(size_t i=0;i<connections_per_endpoint_;i++){
+                    added.push_back(make_client(e.host, e.port));
+                    new_list->push_back(added.back());
+                }
+            }
+            for(auto &client : added) client->async_connect();
+            std::atomic_store(&clients_, std::shared_ptr<const client_list>(std::move(new_list)));
+        }
+
+        /*
+        @brief 在已连接的连接中选择两个 取未完成请求较少的一个
+        */
+        client_ptr pick_two(const client_list& clients){
+            thread_local std::minstd_rand rng(std::random_device{}());
+            size_t n = clients.size();
+            const client_ptr& a = clients[rng() % n];
+            const client_ptr& b = clients[rng() % n];
+            bool a_ok = a->connected(), b_ok = b->connected();
+            if(a_ok && b_ok) return a->outstanding() <= b->outstanding() ? a : b;
+            if(a_ok) return a;
+            if(b_ok) return b;
+            return pick_least(clients); //两个都不可用时退化为遍历
+        }
+        /*
+        @brief 在已连接的连接中选择未完成请求最少的一个
+        */
+        client_ptr pick_least(const client_list& clients){
+            client_ptr best;
+            for(auto &client : clients){
+                if(!client->connected()) continue;
+                if(!best || client->outstanding() < best->outstanding()) best = client;
+            }
+            return best;
+        }
+    public:
+        /*
+        @param io_threads io线程数
+        @param policy 负载均衡策略
+        */
+        explicit rpc_client_pool(size_t io_threads = 1, balance_policy policy = balance_policy::power_of_two)
+            :io_pool_(std::make_shared<rpc_server::io_pool>(io_threads)),clients_(std::make_shared<client_list>()),policy_(policy){
+            thd_ = std::make_shared<std::thread>([pool = io_pool_]{pool->run();});
+        }
+        ~rpc_client_pool(){
+            stop();
+        }
+        /*
+        @brief 添加一个服务端地址 需在connect之前调用
+        @param connections 对该地址建立的连接数 连接依次分配到各io线程
+        */
+        void add_endpoint(const std::string & host, unsigned short port, size_t connections = 1){
+            std::lock_guard<std::mutex> lock(mtx_);
+            auto list = std::make_shared<client_list>(*snapshot());
+            for(size_t i=0;i<connections;i++){
+                list->push_back(make_client(host, port));
+            }
+            std::atomic_store(&clients_, std::shared_ptr<const client_list>(std::move(list)));
+        }
+        /*
+        @brief 通过服务发现获取服务端地址 并订阅地址变化，需在connect之前调用
+        @param registry 服务发现
+        @param service 服务集群名称
+        @param connections 每个地址建立的连接数
+        */
+        void set_discovery(std::shared_ptr<discovery> registry, const std::string& service, size_t connections = 1){
+            discovery_ = std::move(registry);
+            connections_per_endpoint_ = connections;
+            std::lock_guard<std::mutex> lock(mtx_);
+            auto list = std::make_shared<client_list>(*snapshot());
+            for(auto &e : discovery_->lookup(service)){
+                for(size_t i=0;i<connections;i++) list->push_back(make_client(e.host, e.port));
+            }
+            std::atomic_store(&clients_, std::shared_ptr<const client_list>(std::move(list)));
+            watch_state_ = std::make_shared<watch_state>();
+            watch_state_->pool = this;
+            discovery_->watch(service, [state = watch_state_](const std::vector<endpoint_info>& endpoints){
+                std::lock_guard<std::mutex> lock(state->mtx);
+                if(state->pool) state->pool->update_endpoints(endpoints);
+            });
+        }
+        /*
+        @brief 连接所有服务端 所有连接同时发起，最长等待connect_timeout秒
+        @return 已建立的连接数
+        */
+        size_t connect(){
+            auto clients = snapshot();
+            for(auto &client : *clients) client->async_connect();
+            auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(connect_timeout);
+            size_t connected = 0;
+            for(auto &client : *clients){
+                if(client->wait_connected(deadline)) connected++;
+            }
+            return connected;
+        }
+        /*
+        @brief 停止所有连接与io线程 之后仍被持有的连接上的调用立即以errc::not_connected结束
+        */
+        void stop(){
+            if(watch_state_){
+                std::lock_guard<std::mutex> lock(watch_state_->mtx);
+                watch_state_->pool = nullptr;
+            }
+            std::lock_guard<std::mutex> lock(mtx_);
+            if(!thd_) return;
+            io_pool_->stop();
+            if(thd_->joinable()) thd_->join();
+            thd_ = nullptr;
+            for(auto &client : *snapshot()) client->stop();
+        }
+
+        void set_connect_timeout(size_t seconds){
+            connect_timeout = seconds;
+            for(auto &client : *snapshot()) client->set_connect_timeout(seconds);
+        }
+
+        void set_wait_timeout(size_t seconds){
+            wait_timeout = seconds;
+            for(auto &client : *snapshot()) client->set_wait_timeout(seconds);
+        }
+        /*
+        @brief 按负载均衡策略选择一个已连接的连接
+        没有可用连接时抛出boost::system::system_error
+        */
+        client_ptr pick(){
+            auto clients = snapshot();
+            client_ptr client;
+            if(!clients->empty()){
+                client = policy_ == balance_policy::power_of_two ? pick_two(*clients) : pick_least(*clients);
+            }
+            if(!client) throw boost::system::system_error(errc::make_error_code(errc::not_connected));
+            return client;
+        }
+
+        template<typename R = void, typename... Args>
+        R call(const std::string& name, Args&&... args){
+            return pick()->template call<R>(name, std::forward<Args>(args)...);
+        }
+
+        template<typename... Args>
+        std::future<req_result> async_call(const std::string& name, Args&&... args){
+            return pick()->async_call(name, std::forward<Args>(args)...);
+        }
+
+        template<typename Callback, typename... Args>
+        void async_callback(Callback&& callback, const std::string& name, Args&&... args){
+            pick()->async_callback(std::forward<Callback>(callback), name, std::forward<Args>(args)...);
+        }
+
+        /*
+        @brief 可取消的异步调用 取消函数持有所选的客户端，客户端从集群中移除后仍可安全取消
+        */
+        template<typename... Args>
+        pending_call start_call(const std::string& name, Args&&... args){
+            auto client = pick();
+            pending_call call = client->start_call(name, std::forward<Args>(args)...);
+            call.cancel = [client, id = call.id]{ client->cancel(id); };
+            return call;
+        }
+
+        std::future<batch_result> async_batch(const rpc_batch& batch){
+            return pick()->async_batch(batch);
+        }
+
+        template<typename... Args>
+        std::shared_ptr<rpc_stream> open_stream(const std::string& name, Args&&... args){
+            return pick()->open_stream(name, std::forward<Args>(args)...);
+        }
+    };
+}
+
+#endif
@@ -3,12 +3,27 @@
 #include <string>
 #include <deque>
 #include <future>
+#include <iostream>
+#include <cstring>
+#include <atomic>
+#include <stdexcept>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <unordered_map>
+#include <unordered_set>
+#include <algorithm>
+#include <random>
 #include <boost/asio/steady_timer.hpp>
 #include <boost/asio.hpp>
 #include <boost/noncopyable.hpp>
 using boost::asio::ip::tcp;
 #include "constvars.h"
 #include "client_util.h"
+#include "read_buffer.h"
+#include "frame.h"
+#include "util.h"
+#include "call_deadline.h"
 
 using namespace easy_rpc::rpc_server;
 
@@ -16,10 +31,10 @@ namespace easy_rpc{
     using namespace boost::system;
     class req_result{
     private:
-        string_view data_;
+        std::string data_; //读缓冲区会被后续回复覆盖 结果需持有一份拷贝
     public:
         req_result() = default;
-        req_result(string_view data):data_(data){};
+        req_result(string_view data):data_(data.data(), data.size()){};
         bool success() const{
             return !has_error(data_);
         }
@@ -36,30 +51,291 @@ namespace easy_rpc{
         }
 
     };
+    /*
+    @brief 批量调用 依次加入多个调用，作为一个请求发送，服务端按加入的顺序执行并在一个回复中返回全部结果
+    */
+    class rpc_batch{
+    private:
+        buffer_type entries_; //已打包的调用 [服务id, 参数...]
+        uint32_t count_ = 0;
+    public:
+        /*
+        @brief 加入一个调用
+        @param name 服务名称 发送时使用服务id
+        */
+        template<typename... Args>
+        rpc_batch& add(string_view name, Args&&... args){
+            msgpack::pack(entries_, std::forward_as_tuple(method_id(name), std::forward<Args>(args)...));
+            count_++;
+            return *this;
+        }
+        size_t size() const{
+            return count_;
+        }
+        /*
+        @brief 打包为批量请求体 [[服务id, 参数...], ...]
+        @throw std::length_error 请求体超过一个消息的长度上限
+        */
+        buffer_type pack() const{
+            buffer_type buffer(entries_.size() + 8);
+            msgpack::packer<buffer_type> pk(buffer);
+            pk.pack_array(count_);
+            buffer.write(entries_.data(), entries_.size());
+            if(buffer.size() + DEADLINE_LEN >= MAX_BUF_LEN) throw std::length_error("rpc batch is too large");
+            return buffer;
+        }
+    };
+    /*
+    @brief 批量调用的结果 [[结果码, 结果], ...] 按加入批量的顺序一一对应
+    整个批量被拒绝(如服务端繁忙)时回复为[结果码, 错误信息]，此时success()为false
+    */
+    class batch_result{
+    private:
+        msgpack::object_handle handle_; //解码时复制了全部数据 不再引用读缓冲区
+        const msgpack::object& entry(size_t i) const{
+            const msgpack::object& obj = handle_.get();
+            if(!success() || i >= obj.via.array.size) throw std::out_of_range("batch result index out of range");
+            return obj.via.array.ptr[i];
+        }
+    public:
+        batch_result() = default;
+        batch_result(string_view data){
+            msgpack::unpack(handle_, data.data(), data.size());
+        }
+        //整个批量是否被执行
+        bool success() const{
+            const msgpack::object& obj = handle_.get();
+            return obj.type == msgpack::type::ARRAY && (obj.via.array.size == 0 || obj.via.array.ptr[0].type == msgpack::type::ARRAY);
+        }
+        size_t size() const{
+            return success() ? handle_.get().via.array.size : 0;
+        }
+        //第i个调用是否成功
+        bool success(size_t i) const{
+            return entry(i).via.array.ptr[0].as<int>() == (int)result_code::OK;
+        }
+        /*
+        @brief 获取第i个调用的结果 调用失败时抛出异常
+        */
+        template<typename T>
+        T as(size_t i) const{
+            const msgpack::object& e = entry(i);
+            if(e.via.array.ptr[0].as<int>() != (int)result_code::OK){
+                throw std::logic_error(e.via.array.ptr[1].as<std::string>());
+            }
+            return e.via.array.ptr[1].as<T>();
+        }
+        //整个批量被拒绝时的错误信息
+        std::string error() const{
+            const msgpack::object& obj = handle_.get();
+            if(success() || obj.type != msgpack::type::ARRAY || obj.via.array.size < 2) return {};
+            return obj.via.array.ptr[1].as<std::string>();
+        }
+    };
+
+    /*
+    @brief 客户端的流式调用 由rpc_client::open_stream创建，对应服务端以ExecMode::stream注册的服务
+    read按块读取服务端推送的数据，write按块上传数据，finish结束上传，result等待最终结果
+    双方各自最多有STREAM_WINDOW块未被对端消费，额度不足时write阻塞，不能在回调中调用
+    */
+    class rpc_stream{
+    public:
+        using send_type = std::function<bool(buffer_type&&, frame_type)>;
+        rpc_stream(send_type send, std::function<void()> cancel):send_(std::move(send)),cancel_(std::move(cancel)){}
+        /*
+        @brief 上传一块数据 参数会被打包为一个元组
+        @throw std::length_error 数据块超过一个消息的长度上限
+        @return 流已结束或连接已断开时返回false
+        */
+        template<typename... Args>
+        bool write(Args&&... args){
+            {
+                std::unique_lock<std::mutex> lock(mtx_);
+                cond_.wait(lock, [this]{ return credits_ > 0 || ended_; });
+                if(ended_ || input_end_) return false;
+                credits_--;
+            }
+            buffer_type buffer;
+            msgpack::pack(buffer, std::forward_as_tuple(std::forward<Args>(args)...));
+            if(buffer.size() >= MAX_BUF_LEN) throw std::length_error("stream chunk is out of range");
+            return send_(std::move(buffer), frame_type::stream_chunk);
+        }
+        /*
+        @brief 结束上传
+        */
+        void finish(){
+            {
+                std::lock_guard<std::mutex> lock(mtx_);
+                if(ended_ || input_end_) return;
+                input_end_ = true;
+            }
+            send_(msgpack_codec::pack_args(result_code::OK), frame_type::stream_end);
+        }
+        /*
+        @brief 读取服务端推送的一块数据 为服务端打包后的原始数据
+        @return 服务端已回复最终结果且数据已读完时返回false
+        */
+        bool read(std::string & chunk){
+            uint32_t consumed = 0;
+            {
+                std::unique_lock<std::mutex> lock(mtx_);
+                cond_.wait(lock, [this]{ return !inbox_.empty() || ended_; });
+                if(inbox_.empty()) return false;
+                chunk = std::move(inbox_.front());
+                inbox_.pop_front();
+                //每消费半个窗口补充一次额度 最终结果到达后不再补充
+                if(++consumed_ >= STREAM_WINDOW / 2 && !ended_){
+                    consumed = consumed_;
+                    consumed_ = 0;
+                }
+            }
+            if(consumed > 0){
+                buffer_type buffer(sizeof(uint32_t));
+                buffer.write((const char*)&consumed, sizeof(uint32_t));
+                send_(std::move(buffer), frame_type::credit);
+            }
+            return true;
+        }
+        /*
+        @brief 读取服务端推送的一块数据并解码为T
+        */
+        template<typename T>
+        bool read(T & value){
+            std::string chunk;
+            if(!read(chunk)) return false;
+            msgpack_codec codec;
+            value = std::get<0>(codec.unpack<std::tuple<T>>(chunk.data(), chunk.size()));
+            return true;
+        }
+        /*
+        @brief 取消流式调用 服务端阻塞中的读写随即失败，result()抛出error_code::CANCEL
+        */
+        void cancel(){
+            {
+                std::lock_guard<std::mutex> lock(mtx_);
+                if(ended_) return; //已结束的流不再访问客户端 客户端可能已经释放
+            }
+            if(cancel_) cancel_();
+        }
+        /*
+        @brief 等待并获取最终结果 连接断开时抛出异常
+        */
+        req_result result(){
+            std::unique_lock<std::mutex> lock(mtx_);
+            cond_.wait(lock, [this]{ return ended_; });
+            if(ec_) throw boost::system::system_error(ec_);
+            return req_result{result_};
+        }
+        //以下由rpc_client在io线程中调用
+        void on_chunk(string_view data){
+            std::lock_guard<std::mutex> lock(mtx_);
+            inbox_.emplace_back(data.data(), data.size());
+            cond_.notify_all();
+        }
+        void on_credit(uint32_t credits){
+            std::lock_guard<std::mutex> lock(mtx_);
+            credits_ += credits;
+            cond_.notify_all();
+        }
+        void on_end(string_view result, const boost::system::error_code& ec = {}){
+            std::lock_guard<std::mutex> lock(mtx_);
+            if(ended_) return;
+            ended_ = true;
+            result_.assign(result.data(), result.size());
+            ec_ = ec;
+            cond_.notify_all();
+        }
+    private:
+        send_type send_;
+        std::function<void()> cancel_;
+        std::mutex mtx_;
+        std::condition_variable cond_;
+        std::deque<std::string> inbox_; //服务端推送的数据 受额度限制 长度不超过STREAM_WINDOW
+        uint32_t consumed_ = 0;
+        size_t credits_ = STREAM_WINDOW; //还可以上传的块数
+        bool input_end_ = false;
+        bool ended_ = false;
+        std::string result_;
+        boost::system::error_code ec_;
+    };
+
+    /*
+    @brief 可取消的异步调用 由start_call创建
+    */
+    struct pending_call{
+        uint64_t id;
+        std::future<req_result> result;
+        std::function<void()> cancel; //取消该调用 result以error_code::CANCEL结束
+    };
+
+    /*
+    @brief 连接断开时尚未发送的请求如何处理 已发送但未收到回复的请求总是以errc::connection_aborted结束，服务端可能已经执行，重发并不安全
+    fail_fast: 以errc::connection_aborted结束，断线期间发起的调用立即以errc::not_connected结束
+    replay: 保留在发送队列中，重连成功后按原顺序发送；断线期间发起的调用同样排队等待重连
+    */
+    enum class reconnect_policy{
+        fail_fast,
+        replay,
+    };
 
     class rpc_client:private boost::noncopyable{
     private:
-        boost::asio::io_service ios_; //io服务
+        std::shared_ptr<void> ios_owner_; //外部io服务的所有者 最先构造最后析构，保证io服务比客户端存活更久
+        std::unique_ptr<boost::asio::io_service> own_ios_; //独立使用时自有的io服务 使用外部io服务时为空
+        boost::asio::io_service& ios_; //io服务
         tcp::socket socket_;
-        boost::asio::io_service::work work_;
+        std::unique_ptr<boost::asio::io_service::work> work_;
         boost::asio::io_service::strand strand_; //确保同一时刻只有一个任务运行在特定的上下文  也保证了任务序列化执行
-        std::shared_ptr<std::thread> thd_ = nullptr;
+        std::shared_ptr<std::thread> thd_ = nullptr; //自有io服务的线程
+        bool stopped_ = false; //已停止 由queue_mtx_保护
+        std::atomic<size_t> outstanding_{0}; //已发送但尚未收到回复的请求数
         std::string host_;
         unsigned short port_;
         size_t connect_timeout = 2;
         size_t wait_timeout = 2;
-        int reconnect_cnt = -1;
+        int reconnect_cnt = -1; //连接断开或连接失败后的重连次数 -1为不限次数
         bool has_connected = false; //是否成功连接
         std::mutex conn_mtx_;
         std::condition_variable conn_cond_;
         boost::asio::deadline_timer deadline_; //一个计时器
-        using message_type = std::pair<string_view, std::uint64_t>;
+        boost::asio::steady_timer reconnect_timer_; //重连前的退避等待
+        boost::asio::steady_timer heartbeat_timer_; //定期检查连接是否仍然可用
+        size_t backoff_base_ms_ = 100; //第一次重连前的等待时间 之后每次翻倍
+        size_t backoff_max_ms_ = 10000; //重连等待时间的上限
+        size_t heartbeat_seconds_ = 5; //超过该时间没有收到数据时发送心跳 0为不发送
+        size_t heartbeat_timeout_ = 15; //超过该时间没有收到任何数据时认为连接已断开
+        reconnect_policy policy_ = reconnect_policy::fail_fast;
+        //以下状态只在io线程中访问
+        bool online_ = false; //连接可用
+        bool connecting_ = false; //正在连接或等待重连
+        int reconnect_left_ = -1; //本次断线剩余的重连次数
+        size_t reconnect_attempts_ = 0; //本次断线已重连的次数 决定退避时间
+        std::chrono::steady_clock::time_point last_read_; //最近一次收到数据的时间
+        std::minstd_rand rng_{std::random_device{}()}; //退避时间的随机抖动
+        /*
+        @brief 待发送的请求 消息头为[数据长度(4 bytes) 请求id(8 bytes)] 数据由sbuffer释放而来 发送后free
+        有截止时间的请求在消息头之后紧接剩余时间(毫秒)，发送时才计算，排队的时间同样计入
+        */
+        struct message_type{
+            char head[HEAD_LEN + DEADLINE_LEN];
+            string_view data;
+            deadline_type deadline = no_deadline;
+        };
         std::deque<message_type> outbox_; //信息输出队列
-        uint64_t req_id = 0; //请求序列号
+        std::vector<boost::asio::const_buffer> write_buffers_; //合并写的缓冲区列表
+        size_t writing_ = 0; //正在发送的请求数
+        std::atomic<size_t> queued_bytes_{0}; //发送队列中的字节数 调用线程与io线程共同访问
+        size_t high_watermark_ = WRITE_HIGH_WATERMARK; //发送队列超过该字节数时新调用阻塞
+        size_t low_watermark_ = WRITE_LOW_WATERMARK; //阻塞的调用在发送队列回落到该字节数以下时继续
+        bool block_on_full_ = true; //发送队列已满时阻塞等待(最长wait_timeout秒)还是立即失败
+        std::mutex queue_mtx_;
+        std::condition_variable queue_cond_;
+        std::atomic<uint64_t> req_id{0}; //请求序列号
         std::function<void(boost::system::error_code) > err_cb_; //err处理函数
-        std::unordered_map<std::uint64_t , std::shared_ptr<std::promise<req_result>>> future_map_; //相应接收的map
-        char head_[HEAD_LEN] = {}; //回复头
-        std::vector<char> body_; //回复体
+        using completion_type = std::function<void(const boost::system::error_code&, string_view)>;
+        std::unordered_map<std::uint64_t, completion_type> future_map_; //按请求id保存收到回复时的处理函数
+        std::unordered_map<std::uint64_t, std::shared_ptr<rpc_stream>> streams_; //进行中的流式调用
+        read_buffer read_buf_; //读缓冲区 一次读取可包含多个回复
 
         /*
         @breif 重置超时计时器，超时自动关闭socket连接
@@ -74,133 +350,487 @@ namespace easy_rpc{
             });
         }
         /*
+        @brief 等待发送队列回落 额度与上传结束消息很小且用于让对端继续发送，不受水位限制
+        @return 发送队列已满且不阻塞或等待超时时返回false
+        */
+        bool wait_writable(frame_type type){
+            if(type == frame_type::credit || type == frame_type::stream_end) return true;
+            if(queued_bytes_ < high_watermark_) return true;
+            if(!block_on_full_) return false;
+            std::unique_lock<std::mutex> lock(queue_mtx_);
+            return queue_cond_.wait_for(lock, std::chrono::seconds(wait_timeout), [this]{
+                return queued_bytes_ <= low_watermark_ || stopped_;
+            }) && !stopped_;
+        }
+        /*
+        @brief 消息体是否超过一个消息的长度上限 消息头中的长度只有24位，超长的消息无法发送
+        */
+        static bool too_large(size_t size, bool has_deadline){
+            return size + (has_deadline ? DEADLINE_LEN : 0) >= MAX_BUF_LEN;
+        }
+        /*
         @brief 将要写的消息放入消息队列中
+        @return 发送队列已满时返回false 消息未发送
+        @throw std::length_error 消息体为空或超过长度上限 否则长度被截断，服务端会把剩余的数据当作后续消息解析
         */
-        void write(std::uint64_t, buffer_type&& message){
+        bool write(std::uint64_t req_id, buffer_type&& message, frame_type type = frame_type::call, deadline_type deadline = no_deadline){
             size_t size = message.size();
-            assert(size > 0 && size < MAX_BUF_LEN);
+            bool has_deadline = deadline != no_deadline;
+            if(size == 0 || too_large(size, has_deadline)) throw std::length_error("rpc message body is empty or too large");
+            if(!wait_writable(type)) return false;
+            queued_bytes_ += HEAD_LEN + size;
             //获取message中的字符串
-            message_type msg{{message.release(), size}, req_id};
+            message_type msg;
+            encode_head(msg.head, type, (uint32_t)(size + (has_deadline ? DEADLINE_LEN : 0)), req_id, has_deadline);
+            msg.data = {message.release(), size};
+            msg.deadline = deadline;
             strand_.post([this,msg]{
-                outbox_.emplace_back(std::move(msg));
-                if(outbox_.size() > 1) return;
-                this->write();//只有一个任务时写
+                if(!online_ && (policy_ == reconnect_policy::fail_fast || !connecting_)){
+                    discard(msg, errc::make_error_code(errc::not_connected));
+                    return;
+                }
+                outbox_.emplace_back(msg);
+                if(writing_ > 0 || !online_) return; //正在写 完成后会一并发送新加入的请求；未连接时等待重连后发送
+                this->write();
             });
+            return true;
         }
         /*
-        @breif 真实的写入函数
+        @brief 丢弃一条未发送的消息 消息所属的请求以ec结束
+        */
+        void discard(const message_type& msg, const boost::system::error_code& ec){
+            release_queued(HEAD_LEN + msg.data.size());
+            ::free((char*)msg.data.data());
+            frame_head head = decode_head(msg.head);
+            if(head.type == frame_type::call || head.type == frame_type::batch) fail_request(head.req_id, ec);
+        }
+        /*
+        @brief 发送队列减少了bytes字节 回落到低水位以下时唤醒等待中的调用
+        */
+        void release_queued(size_t bytes){
+            if((queued_bytes_ -= bytes) <= low_watermark_){
+                std::lock_guard<std::mutex> lock(queue_mtx_);
+                queue_cond_.notify_all();
+            }
+        }
+        /*
+        @breif 真实的写入函数 将队列中的多条请求合并为一次写操作，数量与字节数都有上限
         */
         void write(){
-            auto msg = outbox_[0];
-            size_t write_len = msg.first.length();
-            std::array<boost::asio::const_buffer, 3> write_buffers;
-            write_buffers[0] = boost::asio::buffer(&write_len, sizeof(int32_t));
-            write_buffers[1] = boost::asio::buffer(&msg.second, sizeof(uint64_t));
-            write_buffers[2] = boost::asio::buffer((char*)msg.first.data(), write_len);
-            boost::asio::async_write(socket_,write_buffers,
+            write_buffers_.clear();
+            size_t bytes = 0;
+            for(auto &msg : outbox_){
+                size_t len = HEAD_LEN + msg.data.size();
+                if(writing_ >= MAX_WRITE_FRAMES || (writing_ > 0 && bytes + len > MAX_WRITE_BYTES)) break;
+                size_t head_len = HEAD_LEN;
+                if(msg.deadline != no_deadline){
+                    //已过期的请求以0发送 由服务端直接回复错误
+                    uint32_t budget_ms = (uint32_t)std::min<int64_t>(call_deadline::remaining(msg.deadline).count(), UINT32_MAX);
+                    memcpy(msg.head + HEAD_LEN, &budget_ms, DEADLINE_LEN);
+                    head_len += DEADLINE_LEN;
+                }
+                write_buffers_.push_back(boost::asio::buffer(msg.head, head_len));
+                write_buffers_.push_back(boost::asio::buffer(msg.data.data(), msg.data.size()));
+                bytes += len;
+                writing_++;
+            }
+            boost::asio::async_write(socket_,write_buffers_,
                 strand_.wrap([this](const boost::system::error_code& ec,const size_t length){
-                    ::free((char*)outbox_.front().first.data());
-                    outbox_.pop_front();
+                    size_t bytes = 0;
+                    for(;writing_ > 0;writing_--){
+                        bytes += HEAD_LEN + outbox_.front().data.size();
+                        ::free((char*)outbox_.front().data.data());
+                        outbox_.pop_front();
+                    }
+                    release_queued(bytes);
                     if(ec){
-                        if(err_cb_) err_cb_(ec);
+                        on_disconnect(ec);
                         return;
                      }
-                     if(!outbox_.empty()){
+                     if(!outbox_.empty() && online_){
                         this->write();
                      }
                 })
             );
         }
         /*
-        @brief 读取数据
+        @brief 读取数据 有多少读多少，读到的数据可能包含多个回复
         */
         void do_read(){
-            boost::asio::async_read(socket_, boost::asio::buffer(head_),
-            [this](const boost::system::error_code & ec, const size_t length){
-                if(!socket_.is_open()){
-                    if(err_cb_) err_cb_(errc::make_error_code(errc::connection_aborted));
+            socket_.async_read_some(boost::asio::buffer(read_buf_.tail(), read_buf_.tail_size()),
+            strand_.wrap([this](const boost::system::error_code & ec, const size_t length){
+                if(ec || !socket_.is_open()){
+                    on_disconnect(ec ? ec : errc::make_error_code(errc::connection_aborted));
                     return;
                 }
-                if(!ec){
-                    const uint32_t body_len = *((uint32_t*)(head_));
-                    auto req_id = *((std::uint64_t*)head_+sizeof(int32_t));
-                    if(body_len > 0 && body_len < MAX_BUF_LEN){
-                        if(body_.size() < body_len) body_.resize(body_len);
-                        read_body(req_id, body_len);
-                        return;
-                    }
-                    if(body_len == 0 || body_len > MAX_BUF_LEN){
-                        call_back(req_id, errc::make_error_code(errc::invalid_argument), {});
-                        close();
-                        return;
-                    }
-                }else{
-                    if(err_cb_) err_cb_(ec);
-                    close();
-                }
-            });
+                last_read_ = std::chrono::steady_clock::now();
+                read_buf_.commit(length);
+                if(parse()) do_read();
+            }));
         }
         /*
-        @brief 读取数据体
+        @brief 解析读缓冲区中所有完整的回复 [数据长度(4 bytes) 请求id(8 bytes) 数据]
+        @return 数据异常关闭连接时返回false
         */
-        void read_body(std::uint64_t req_id, size_t body_len){
-            boost::asio::async_read(socket_,boost::asio::buffer(body_.data(), body_len),
-            [this, req_id, body_len](boost::system::error_code &ec, std::size_t length){
-                if(!socket_.is_open()){
-                    call_back(req_id,errc::make_error_code(errc::connection_aborted), {});
-                    return;
+        bool parse(){
+            frame_head head;
+            while(read_buf_.peek_head(head)){
+                if(head.body_len == 0){
+                    //服务端对心跳的回复 收到即说明连接可用
+                    read_buf_.consume(HEAD_LEN);
+                    continue;
                 }
-                if(!ec){
-                    call_back(req_id, ec, {body_.data(), body_len});
-                    do_read();
-                }else{
-                    call_back(req_id,ec,{});
+                if(head.body_len >= MAX_BUF_LEN){
+                    on_disconnect(errc::make_error_code(errc::invalid_argument));
+                    return false;
                 }
-            });
+                if(read_buf_.size() < HEAD_LEN + head.body_len){
+                    read_buf_.reserve(HEAD_LEN + head.body_len);
+                    break;
+                }
+                on_frame(head, {read_buf_.data() + HEAD_LEN, head.body_len});
+                read_buf_.consume(HEAD_LEN + head.body_len);
+            }
+            read_buf_.reserve(HEAD_LEN);
+            return true;
         }
         /*
-        @brief 获取异步的结果
+        @brief 登记一个请求 收到对应的回复时以结果构造Result并交给future
         */
-        std::future<req_result> get_future(){
-            auto p = std::make_shared<std::promise<req_result>>();
-            std::future<req_result> future = p->get_future(); //获取结果
-            strand_.post([this, p = std::move(p)]()mutable{
-                future_map_.emplace(req_id, std::move(p));
+        template<typename Result>
+        std::future<Result> get_future(std::uint64_t id){
+            auto p = std::make_shared<std::promise<Result>>();
+            std::future<Result> future = p->get_future(); //获取结果
+            completion_type completion = [p](const boost::system::error_code& ec, string_view data){
+                if(ec){
+                    p->set_exception(std::make_exception_ptr(boost::system::system_error(ec)));
+                    return;
+                }
+                try{
+                    p->set_value(Result{data});
+                }catch(...){
+                    p->set_exception(std::current_exception());
+                }
+            };
+            outstanding_++;
+            strand_.post([this, id, completion = std::move(completion)]()mutable{
+                future_map_.emplace(id, std::move(completion));
             }); //加入到future_map中，strand_.post保证了任务的序列化执行，减少了锁的使用
             return future;
         }
         /*
-        @brief 异步读时的call_back，用于将读取的结果保存
+        @brief 处理一个回复 流式调用的数据块与额度交给对应的流，其余为最终结果
+        */
+        void on_frame(const frame_head& head, string_view data){
+            auto it = streams_.empty() ? streams_.end() : streams_.find(head.req_id);
+            if(it != streams_.end()){
+                if(head.type == frame_type::stream_chunk){
+                    it->second->on_chunk(data);
+                }else if(head.type == frame_type::credit){
+                    uint32_t credits = 0;
+                    if(data.size() >= sizeof(uint32_t)) memcpy(&credits, data.data(), sizeof(uint32_t));
+                    it->second->on_credit(credits);
+                }else{
+                    it->second->on_end(data);
+                    streams_.erase(it);
+                }
+                return;
+            }
+            if(head.type == frame_type::stream_chunk || head.type == frame_type::credit) return;
+            call_back(head.req_id, {}, data);
+        }
+        /*
+        @brief 异步读时的call_back，将回复交给对应请求的处理函数
         */
         void call_back(uint64_t req_id, const boost::system::error_code &ec, string_view data){
-            if(!ec){
-                auto& f = future_map_[req_id];
-                f->set_value(req_result{data});
-                strand_.post([this,req_id](){
-                    future_map_.erase(req_id);
+            auto it = future_map_.find(req_id);
+            if(it == future_map_.end()) return;
+            completion_type completion = std::move(it->second);
+            future_map_.erase(it);
+            outstanding_--;
+            completion(ec, data);
+        }
+        /*
+        @brief 以错误结束一个尚未收到回复的请求 流式调用同样结束
+        */
+        void fail_request(uint64_t req_id, const boost::system::error_code &ec){
+            auto it = streams_.find(req_id);
+            if(it != streams_.end()){
+                auto stream = std::move(it->second);
+                streams_.erase(it);
+                stream->on_end({}, ec);
+                return;
+            }
+            call_back(req_id, ec, {});
+        }
+
+        /*
+        @brief 发送一个请求 发送队列已满时以errc::no_buffer_space结束该请求，请求体超过长度上限时以errc::message_size结束
+        */
+        template<typename Result>
+        std::future<Result> request(std::uint64_t id, buffer_type&& body, frame_type type = frame_type::call, deadline_type deadline = no_deadline){
+            if(is_stopped()){
+                //已停止的客户端不会再处理任何请求
+                std::promise<Result> p;
+                p.set_exception(std::make_exception_ptr(boost::system::system_error(errc::make_error_code(errc::not_connected))));
+                return p.get_future();
+            }
+            if(too_large(body.size(), deadline != no_deadline)){
+                std::promise<Result> p;
+                p.set_exception(std::make_exception_ptr(boost::system::system_error(errc::make_error_code(errc::message_size))));
+                return p.get_future();
+            }
+            auto future = get_future<Result>(id);
+            if(!write(id, std::move(body), type, deadline)){
+                strand_.post([this, id]{
+                    call_back(id, errc::make_error_code(errc::no_buffer_space), {});
                 });
             }
+            return future;
+        }
+
+        bool is_stopped(){
+            std::lock_guard<std::mutex> lock(queue_mtx_);
+            return stopped_;
+        }
+        /*
+        @brief 发起一次连接 失败时按退避时间重试
+        */
+        void do_connect(){
+            boost::system::error_code ignored_ec;
+            socket_.close(ignored_ec); //上一次失败的连接可能仍处于打开状态
+            reset_deadline_timer(connect_timeout);
+            auto addr = boost::asio::ip::address::from_string(host_);
+            socket_.async_connect({addr, port_}, strand_.wrap([this](const boost::system::error_code& ec){
+                if(ec){
+                    std::cout << ec.message() << std::endl;
+                    schedule_reconnect();
+                    return;
+                }
+                deadline_.cancel();//取消超时断连
+                online_ = true;
+                connecting_ = false;
+                reconnect_attempts_ = 0;
+                last_read_ = std::chrono::steady_clock::now();
+                read_buf_.reserve(HEAD_LEN); //断线时缓冲区已归还
+                do_read();
+                start_heartbeat();
+                {
+                    std::lock_guard<std::mutex> lock(conn_mtx_);
+                    has_connected = true;
+                }
+                conn_cond_.notify_all();
+                //断线期间保留的请求
+                if(!outbox_.empty() && writing_ == 0) write();
+            }));
+        }
+        /*
+        @brief 按指数退避等待后重连 等待时间在[t/2, t]之间随机，避免大量客户端在服务端恢复时同时重连
+        重连次数用尽后放弃，队列中的请求以errc::not_connected结束
+        */
+        void schedule_reconnect(){
+            if(is_stopped()) return;
+            if(reconnect_left_ == 0){
+                connecting_ = false;
+                while(outbox_.size() > writing_){
+                    message_type msg = outbox_.back();
+                    outbox_.pop_back();
+                    discard(msg, errc::make_error_code(errc::not_connected));
+                }
+                return;
+            }
+            if(reconnect_left_ > 0) reconnect_left_--;
+            connecting_ = true;
+            size_t delay = std::min(backoff_max_ms_, backoff_base_ms_ << std::min<size_t>(reconnect_attempts_++, 16));
+            delay = delay / 2 + std::uniform_int_distribution<size_t>(0, delay - delay / 2)(rng_);
+            reconnect_timer_.expires_after(std::chrono::milliseconds(delay));
+            reconnect_timer_.async_wait(strand_.wrap([this](const boost::system::error_code& ec){
+                if(!ec) do_connect();
+            }));
+        }
+        /*
+        @brief 连接断开 已发送的请求以错误结束，未发送的请求按重连策略结束或保留，然后开始重连
+        */
+        void on_disconnect(const boost::system::error_code& ec){
+            if(!online_) return; //读写可能先后失败 只处理一次
+            if(err_cb_) err_cb_(ec);
+            close();
+            //正在写的消息由写操作的完成回调释放 其余为未发送的消息
+            std::deque<message_type> kept;
+            std::unordered_set<uint64_t> kept_ids;
+            while(outbox_.size() > writing_){
+                message_type msg = outbox_.back();
+                outbox_.pop_back();
+                frame_head head = decode_head(msg.head);
+                if(policy_ == reconnect_policy::replay && head.body_len > 0 && future_map_.count(head.req_id) > 0){
+                    kept.push_front(msg);
+                    kept_ids.insert(head.req_id);
+                }else{
+                    discard(msg, errc::make_error_code(errc::connection_aborted));
+                }
+            }
+            std::vector<completion_type> failed;
+            for(auto it = future_map_.begin(); it != future_map_.end();){
+                if(kept_ids.count(it->first) > 0){
+                    ++it;
+                    continue;
+                }
+                failed.push_back(std::move(it->second));
+                it = future_map_.erase(it);
+                outstanding_--;
+            }
+            outbox_.insert(outbox_.end(), kept.begin(), kept.end());
+            for(auto &completion : failed) completion(errc::make_error_code(errc::connection_aborted), {});
+            reconnect_left_ = reconnect_cnt;
+            schedule_reconnect();
+        }
+        /*
+        @brief 超过heartbeat_seconds_没有收到数据时发送一个空消息，服务端原样回复；
+        超过heartbeat_timeout_仍没有收到任何数据时认为连接已半开(对端断电或网络中断而本端未收到通知)，断开并重连
+        */
+        void start_heartbeat(){
+            if(heartbeat_seconds_ == 0) return;
+            heartbeat_timer_.expires_after(std::chrono::seconds(heartbeat_seconds_));
+            heartbeat_timer_.async_wait(strand_.wrap([this](const boost::system::error_code& ec){
+                if(ec || !online_) return;
+                auto idle = std::chrono::steady_clock::now() - last_read_;
+                if(idle >= std::chrono::seconds(heartbeat_timeout_)){
+                    on_disconnect(errc::make_error_code(errc::timed_out));
+                    return;
+                }
+                if(idle >= std::chrono::seconds(heartbeat_seconds_)) send_control(frame_type::call, 0);
+                start_heartbeat();
+            }));
+        }
+        /*
+        @brief 发送没有数据的控制消息 空的普通调用为心跳，另有取消消息
+        */
+        void send_control(frame_type type, uint64_t id){
+            message_type msg;
+            encode_head(msg.head, type, 0, id);
+            queued_bytes_ += HEAD_LEN;
+            outbox_.emplace_back(msg);
+            if(writing_ == 0) write();
+        }
+
+        /*
+        @brief 停止客户端时关闭连接并取消全部计时器 之后不再重连
+        */
+        void shutdown(){
+            close();
+            reconnect_timer_.cancel();
+            deadline_.cancel();
+            //不会再有回复 未发送与等待回复的请求全部以errc::connection_aborted结束
+            auto ec = errc::make_error_code(errc::connection_aborted);
+            while(outbox_.size() > writing_){
+                message_type msg = outbox_.back();
+                outbox_.pop_back();
+                discard(msg, ec);
+            }
+            std::vector<completion_type> failed;
+            for(auto &kv : future_map_) failed.push_back(std::move(kv.second));
+            outstanding_ -= future_map_.size();
+            future_map_.clear();
+            for(auto &completion : failed) completion(ec, {});
         }
 
         void close(){
-            has_connected = true;
+            online_ = false;
+            heartbeat_timer_.cancel();
+            //唤醒等待中的流式调用
+            for(auto &kv : streams_) kv.second->on_end({}, errc::make_error_code(errc::connection_aborted));
+            streams_.clear();
+            {
+                std::lock_guard<std::mutex> lock(conn_mtx_);
+                has_connected = false;
+            }
             if(socket_.is_open()){
                 boost::system::error_code ignored_ec;
                 socket_.shutdown(tcp::socket::shutdown_both, ignored_ec);
                 socket_.close(ignored_ec);
             }
+            //丢弃未解析完的半个回复 新连接的数据不能接在其后
+            read_buf_.clear();
         }
 
     public:
-        rpc_client(const std::string & host, unsigned short port):socket_(ios_),work_(ios_),strand_(ios_),deadline_(ios_),
-            host_(host),port_(port),body_(INIT_BUF_SIZE){
+        /*
+        @brief 创建使用自有io线程的客户端
+        */
+        rpc_client(const std::string & host, unsigned short port):own_ios_(new boost::asio::io_service),ios_(*own_ios_),socket_(ios_),
+            work_(new boost::asio::io_service::work(ios_)),strand_(ios_),host_(host),port_(port),deadline_(ios_),
+            reconnect_timer_(ios_),heartbeat_timer_(ios_){
                 thd_ = std::make_shared<std::thread>([this]{
                     ios_.run();
                 });
         }
+        /*
+        @brief 创建运行在外部io服务上的客户端 多个客户端可以共用一组io线程，io服务需由外部运行
+        @param owner io服务的所有者 客户端持有它直到析构，为空时由调用者保证io服务比客户端存活更久
+        */
+        rpc_client(boost::asio::io_service & ios, const std::string & host, unsigned short port, std::shared_ptr<void> owner = nullptr)
+            :ios_owner_(std::move(owner)),ios_(ios),socket_(ios_),
+            strand_(ios_),host_(host),port_(port),deadline_(ios_),reconnect_timer_(ios_),heartbeat_timer_(ios_){
+        }
         ~rpc_client(){
             stop();
         }
+        /*
+        @brief 停止客户端 使用自有io服务时停止io服务并等待io线程退出
+        */
+        void stop(){
+            {
+                std::lock_guard<std::mutex> lock(queue_mtx_);
+                if(stopped_) return;
+                stopped_ = true;
+            }
+            queue_cond_.notify_all(); //唤醒因发送队列已满而阻塞的调用
+            if(ios_.stopped() || strand_.running_in_this_thread()){
+                //io服务已停止或在本客户端的回调中停止 没有其他线程会同时访问
+                shutdown();
+            }else{
+                //io服务仍在运行 在io线程中关闭连接并等待完成，连接状态只在io线程中访问
+                auto closed = std::make_shared<std::promise<void>>();
+                auto done = closed->get_future();
+                strand_.post([this, closed]{
+                    shutdown();
+                    //关闭时被取消的异步操作的完成回调已排在io服务的队列中，绕队列一圈后再返回，之后不再有回调访问本对象
+                    ios_.post([this, closed]{
+                        strand_.post([closed]{ closed->set_value(); });
+                    });
+                });
+                done.wait();
+            }
+            if(thd_){
+                ios_.stop();
+                if(thd_->get_id() == std::this_thread::get_id()){
+                    thd_->detach(); //在自有io线程的回调中停止 线程随回调返回退出
+                }else if(thd_->joinable()){
+                    thd_->join();
+                }
+                thd_ = nullptr;
+            }
+        }
+        /*
+        @brief 是否已连接
+        */
+        bool connected(){
+            std::lock_guard<std::mutex> lock(conn_mtx_);
+            return has_connected;
+        }
+        const std::string& host() const{
+            return host_;
+        }
+
+        unsigned short port() const{
+            return port_;
+        }
+        /*
+        @brief 已发送但尚未收到回复的请求数 用于负载均衡
+        */
+        size_t outstanding() const{
+            return outstanding_.load(std::memory_order_relaxed);
+        }
 
         void set_connect_timeout(size_t seconds){
             connect_timeout = seconds;
@@ -209,32 +839,221 @@ namespace easy_rpc{
         void set_reconnect_timeout(int reconn_cnt){
             reconnect_cnt = reconn_cnt;
         }
+        /*
+        @brief 设置重连的退避时间 第n次重连前等待[t/2, t]毫秒，t = min(max_ms, base_ms * 2^n)
+        */
+        void set_reconnect_backoff(size_t base_ms, size_t max_ms){
+            backoff_base_ms_ = base_ms > 0 ? base_ms : 1;
+            backoff_max_ms_ = max_ms > backoff_base_ms_ ? max_ms : backoff_base_ms_;
+        }
+        /*
+        @brief 设置连接断开时未发送请求的处理方式，需在连接之前设置
+        */
+        void set_reconnect_policy(reconnect_policy policy){
+            policy_ = policy;
+        }
+        /*
+        @brief 设置心跳 需在连接之前设置
+        @param interval_seconds 超过该时间没有收到数据时发送心跳 0为关闭心跳与半开检测
+        @param timeout_seconds 超过该时间没有收到任何数据时断开重连 0为3倍的心跳间隔
+        */
+        void set_heartbeat(size_t interval_seconds, size_t timeout_seconds = 0){
+            heartbeat_seconds_ = interval_seconds;
+            heartbeat_timeout_ = timeout_seconds > 0 ? timeout_seconds : interval_seconds * 3;
+        }
 
         void set_wait_timeout(size_t seconds){
             wait_timeout = seconds;
         }
+        /*
+        @brief 设置发送队列的高低水位，需在发起调用之前设置
+        @param high 发送队列超过该字节数时新调用被限制
+        @param low 被阻塞的调用在发送队列回落到该字节数以下时继续
+        @param block 队列已满时阻塞等待(最长wait_timeout秒) 为false时立即失败，调用以errc::no_buffer_space结束
+        */
+        void set_write_watermark(size_t high, size_t low, bool block = true){
+            high_watermark_ = high;
+            low_watermark_ = low < high ? low : high;
+            block_on_full_ = block;
+        }
 
-        void async_connect(){
-            reset_deadline_timer(connect_timeout);
-            auto addr = boost::asio::ip::address::from_string(host_);
-            socket_.async_connect({addr, port_},[this](const boost::system::error_code& ec){
-                if(ec){
-                    std::cout << ec.message() << std::endl;
-                    has_connected =  false;
-                    if(reconnect_cnt == 0) return;
-                    //再次重新连接
-                    if(reconnect_cnt > 0){
-                        reconnect_cnt --;
-                    }
-                    socket_ = decltype(socket_)(ios_);
-                    async_connect();
-
-                }else{
-                    has_connected = true;
-                    deadline_.cancel();//取消超时断连
-                    do_read();
-                    conn_cond_.notify_one();
+        /*
+        @brief 连接服务端 等待连接建立，最长connect_timeout秒
+        @return 是否连接成功
+        */
+        bool connect(){
+            async_connect();
+            return wait_connected(std::chrono::steady_clock::now() + std::chrono::seconds(connect_timeout));
+        }
+        /*
+        @brief 等待连接建立 不发起连接
+        @param deadline 最长等待到该时间
+        @return 是否已连接
+        */
+        bool wait_connected(std::chrono::steady_clock::time_point deadline){
+            std::unique_lock<std::mutex> lock(conn_mtx_);
+            return conn_cond_.wait_until(lock, deadline, [this]{ return has_connected; });
+        }
+        /*
+        @brief 同步调用 最长等待wait_timeout秒，等待时间作为截止时间随请求发送
+        @param name 服务名称
+        @param args 调用参数
+        @return 服务的返回值 调用失败时抛出std::logic_error，超时或连接断开时抛出boost::system::system_error
+        */
+        template<typename R = void, typename... Args>
+        R call(const std::string& name, Args&&... args){
+            return call_for<R>(std::chrono::seconds(wait_timeout), name, std::forward<Args>(args)...);
+        }
+        /*
+        @brief 指定截止时间的同步调用 截止时间随请求发送，服务端不再执行已过期的请求
+        @param timeout 从现在起的最长等待时间
+        */
+        template<typename R = void, typename... Args>
+        R call_for(std::chrono::milliseconds timeout, const std::string& name, Args&&... args){
+            uint64_t id = ++req_id;
+            auto deadline = std::chrono::steady_clock::now() + timeout;
+            auto future = request<req_result>(id, msgpack_codec::pack_args(method_id(name), std::forward<Args>(args)...),
+                frame_type::call, deadline);
+            if(future.wait_until(deadline) == std::future_status::timeout){
+                //不再等待该请求 通知服务端取消，仍在发送队列中的请求不再发送，之后到达的回复直接丢弃
+                cancel(id);
+                throw boost::system::system_error(errc::make_error_code(errc::timed_out));
+            }
+            req_result result = future.get();
+            if constexpr(std::is_void<R>::value){
+                result.as();
+            }else{
+                return result.template as<R>();
+            }
+        }
+        /*
+        @brief 异步调用 每个调用有独立的请求id，同一连接上可以同时有任意多个调用等待回复
+        @return 收到回复后得到结果
+        */
+        template<typename... Args>
+        std::future<req_result> async_call(const std::string& name, Args&&... args){
+            uint64_t id = ++req_id;
+            return request<req_result>(id, msgpack_codec::pack_args(method_id(name), std::forward<Args>(args)...));
+        }
+        /*
+        @brief 指定截止时间的异步调用 过期后服务端不再执行，以"deadline exceeded"错误回复
+        @param timeout 从现在起的剩余时间
+        */
+        template<typename... Args>
+        std::future<req_result> async_call_for(std::chrono::milliseconds timeout, const std::string& name, Args&&... args){
+            uint64_t id = ++req_id;
+            return request<req_result>(id, msgpack_codec::pack_args(method_id(name), std::forward<Args>(args)...),
+                frame_type::call, std::chrono::steady_clock::now() + timeout);
+        }
+        /*
+        @brief 回调方式的异步调用 不经过promise/future，也不复制回复
+        @param callback 签名为void(const boost::system::error_code&, string_view)，在io线程中被调用，不能阻塞
+        回复数据只在回调期间有效，可用has_error与get_result<T>解码
+        */
+        template<typename Callback, typename... Args>
+        uint64_t async_callback(Callback&& callback, const std::string& name, Args&&... args){
+            uint64_t id = ++req_id;
+            if(is_stopped()){
+                callback(errc::make_error_code(errc::not_connected), {});
+                return id;
+            }
+            buffer_type body = msgpack_codec::pack_args(method_id(name), std::forward<Args>(args)...);
+            if(too_large(body.size(), false)){
+                callback(errc::make_error_code(errc::message_size), {});
+                return id;
+            }
+            outstanding_++;
+            strand_.post([this, id, callback = completion_type(std::forward<Callback>(callback))]()mutable{
+                future_map_.emplace(id, std::move(callback));
+            });
+            if(!write(id, std::move(body))){
+                strand_.post([this, id]{
+                    call_back(id, errc::make_error_code(errc::no_buffer_space), {});
+                });
+            }
+            return id;
+        }
+        /*
+        @brief 可取消的异步调用 对冲请求(hedging)或扇出调用中不再需要的调用可以随时取消，不再占用服务端资源
+        */
+        template<typename... Args>
+        pending_call start_call(const std::string& name, Args&&... args){
+            uint64_t id = ++req_id;
+            auto future = request<req_result>(id, msgpack_codec::pack_args(method_id(name), std::forward<Args>(args)...));
+            return {id, std::move(future), [this, id]{ cancel(id); }};
+        }
+        /*
+        @brief 取消一个尚未完成的调用 调用以error_code::CANCEL结束，之后到达的回复直接丢弃
+        尚未发送的请求不再发送；已发送的请求通知服务端，服务端丢弃仍在排队的请求，正在执行的请求通过cancel_token得知已被取消
+        @param id start_call或async_callback返回的请求id，也可以是流式调用的id
+        */
+        void cancel(uint64_t id){
+            strand_.post([this, id]{
+                if(future_map_.count(id) == 0 && streams_.count(id) == 0) return; //已经完成
+                fail_request(id, make_error_code(error_code::CANCEL));
+                for(size_t i = writing_; i < outbox_.size(); i++){
+                    auto &msg = outbox_[i];
+                    frame_head head = decode_head(msg.head);
+                    if(head.req_id != id || (head.type != frame_type::call && head.type != frame_type::batch)) continue;
+                    //仍在发送队列中 释放请求数据并改为取消消息，服务端忽略未知请求的取消；不从队列中间删除，以免影响正在写的缓冲区
+                    release_queued(msg.data.size());
+                    ::free((char*)msg.data.data());
+                    msg.data = {};
+                    msg.deadline = no_deadline;
+                    encode_head(msg.head, frame_type::cancel, 0, id);
+                    return;
                 }
+                if(online_) send_control(frame_type::cancel, id);
+            });
+        }
+        /*
+        @brief 发送批量调用
+        @return 全部调用完成后得到的结果
+        */
+        std::future<batch_result> async_batch(const rpc_batch& batch){
+            uint64_t id = ++req_id;
+            return request<batch_result>(id, batch.pack(), frame_type::batch);
+        }
+
+        /*
+        @brief 发起流式调用 对应服务端以ExecMode::stream注册的服务
+        @param name 服务名称
+        @param args 调用参数
+        */
+        template<typename... Args>
+        std::shared_ptr<rpc_stream> open_stream(const std::string& name, Args&&... args){
+            uint64_t id = ++req_id;
+            auto stream = std::make_shared<rpc_stream>([this, id](buffer_type&& data, frame_type type){
+                return write(id, std::move(data), type);
+            }, [this, id]{ cancel(id); });
+            buffer_type body = msgpack_codec::pack_args(method_id(name), std::forward<Args>(args)...);
+            if(too_large(body.size(), false)){
+                stream->on_end({}, errc::make_error_code(errc::message_size));
+                return stream;
+            }
+            strand_.post([this, id, stream]{
+                streams_.emplace(id, stream);
+            });
+            if(!write(id, std::move(body))){
+                strand_.post([this, id, stream]{
+                    streams_.erase(id);
+                    stream->on_end({}, errc::make_error_code(errc::no_buffer_space));
+                });
+            }
+            return stream;
+        }
+
+        /*
+        @brief 异步连接服务端 失败或之后连接断开时按退避时间自动重连，最多reconnect_cnt次
+        已连接或正在连接时不做任何事
+        */
+        void async_connect(){
+            strand_.post([this]{
+                if(online_ || connecting_ || is_stopped()) return;
+                connecting_ = true;
+                reconnect_left_ = reconnect_cnt;
+                reconnect_attempts_ = 0;
+                do_connect();
             });
         }
 
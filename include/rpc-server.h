@@ -3,9 +3,14 @@
 
 #include <thread>
 #include <mutex>
+#include <condition_variable>
+#include <future>
 #include "connection.h"
+#include "connection_table.h"
 #include "io_pool.h"
 #include "router.h"
+#include "worker_pool.h"
+#include "discovery.h"
 
 using boost::asio::ip::tcp;
 
@@ -13,42 +18,59 @@ namespace easy_rpc{
 namespace rpc_server{
 class RpcServer{
 private:
+    typedef std::shared_ptr<tcp::acceptor> acceptor_ptr;
     io_pool io_pool_; //连接池
-    tcp::acceptor acceptor_;//连接接受器
-    std::shared_ptr<Connection> conn_;//当前连接
+    unsigned short port_; //服务端口号
+    bool reuse_port_ = false; //是否每个io线程各自监听端口
+    std::vector<acceptor_ptr> acceptors_;//连接接受器 reuse_port模式下每个io线程一个
     std::shared_ptr<std::thread> thd_;//服务线程
     std::size_t timeout_second_;
-    std::unordered_map<int64_t,std::shared_ptr<Connection>> connections_;//已有连接
-    int64_t conn_id = 0;
-    std::mutex mtx_;
-    std::shared_ptr<std::thread> check_thread_;
-    size_t __check_seconds_;
-    bool stop_check_ = false; //停止标志位
+    connection_table connections_;//已有连接 按连接id分片加锁
+    std::atomic<int64_t> conn_id{0};
+    std::unique_ptr<worker_pool> worker_pool_; //执行offload模式处理函数的计算线程池 可选
+    size_t high_watermark_ = WRITE_HIGH_WATERMARK; //每个连接回复队列的高水位
+    size_t low_watermark_ = WRITE_LOW_WATERMARK; //每个连接回复队列的低水位
+    std::shared_ptr<discovery> discovery_; //服务发现 为空时不注册
+    std::string service_; //注册的服务集群名称
+    std::string host_; //注册的对外地址
+    std::size_t announce_seconds_ = 5; //定期上报负载的间隔
+    std::thread announce_thd_; //上报线程 注册文件等后端的读写会阻塞，不能占用io线程
+    std::mutex announce_mtx_;
+    std::condition_variable announce_cond_;
+    bool announce_stop_ = false;
 
-    void do_accept();
-    void clean();
-    void callback(const std::string &topic, std::string&& result,Connection * conn, bool has_error = false);
+    acceptor_ptr listen(boost::asio::io_service& io_service);
+    void do_accept(acceptor_ptr acceptor, io_worker* worker);
+    void accepted(std::shared_ptr<Connection> conn);
+    void callback(std::string_view topic, buffer_type&& result,Connection * conn, uint64_t req_id, bool has_error = false);
+    void announce();
+    void announce_loop();
+    void flush_io();
 public:
     RpcServer(short port, size_t size, size_t timeout_seds = 15, size_t check_seds = 10);
     RpcServer(RpcServer &) = delete;
     RpcServer & operator = (RpcServer &) = delete;
     ~RpcServer();
     void run();
+    void set_worker_pool(size_t pool_size, size_t max_queue = 1024);
+    void set_reuse_port(bool enable);
+    void set_write_watermark(size_t high, size_t low);
+    void set_discovery(std::shared_ptr<discovery> registry, const std::string& service, const std::string& host, size_t announce_seconds = 5);
     /*
     @brief 向Router中注册非成员函数
     */
-    template<ExecMode model,typename Function>
+    template<ExecMode model,ExecPolicy policy = ExecPolicy::inplace,typename Function>
     void register_handler(std::string const & name, const Function& f){
-        Router::get().register_handler<model> (name,f);
+        Router::get().register_handler<model,policy> (name,f);
     }
     /*
     @brief 向Router中注册成员函数
     */
-    template<ExecMode model ,typename Function, typename Self>
+    template<ExecMode model,ExecPolicy policy = ExecPolicy::inplace,typename Function, typename Self>
     void register_handler(std::string const &name,const Function &f, Self* self){
-        Router::get().register_handler<model>(name,f,self);
+        Router::get().register_handler<model,policy>(name,f,self);
     }
-    void response(int64_t conn_id, std::string && result);
+    void response(int64_t conn_id, uint64_t req_id, buffer_type && result);
 };
 }
 }
@@ -0,0 +1,127 @@
+#ifndef STREAM_HANDLE
+#define STREAM_HANDLE
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include "codec.h"
+#include "constvars.h"
+#include "frame.h"
+#include "buffer_pool.h"
+
+namespace easy_rpc{
+namespace rpc_server{
+class Connection;
+/*
+@brief 一个流式调用的状态 由句柄与连接共同持有
+连接在io线程中调用grant/push/end_input/abort，处理函数在自己的线程中读写
+*/
+class stream_state{
+public:
+    std::weak_ptr<Connection> conn;
+    int64_t conn_id;
+    uint64_t req_id;
+    std::atomic_bool done{false}; //已发送最终结果
+
+    void grant(uint32_t credits);
+    bool push(std::string && chunk);
+    void end_input();
+    void abort();
+    /*
+    @brief 等待发送额度 额度不足时阻塞
+    @return 连接已关闭或流已结束时返回false
+    */
+    bool acquire_credit();
+    /*
+    @brief 读取客户端发来的一块数据 没有数据时阻塞
+    @param consumed 返回累计已读取但尚未补充给客户端的块数
+    @return 客户端已结束上传或连接已关闭时返回false
+    */
+    bool pop(std::string & chunk, uint32_t & consumed);
+private:
+    std::mutex mtx_;
+    std::condition_variable cond_;
+    size_t credits_ = STREAM_WINDOW; //还可以发送给客户端的块数
+    std::deque<std::string> inbox_; //客户端发来的数据 客户端同样受额度限制 队列长度不超过STREAM_WINDOW
+    uint32_t consumed_ = 0;
+    uint32_t unacked_ = 0; //已收到但尚未为客户端补充额度的块数 超过STREAM_WINDOW说明客户端无视额度
+    bool input_end_ = false;
+    bool aborted_ = false;
+};
+/*
+@brief 流式调用句柄 处理函数以stream_handle作为第一个参数 并以ExecMode::stream注册
+write按块向客户端推送数据，read按块读取客户端上传的数据，最后通过response/error回复最终结果
+每块数据大小受MAX_BUF_LEN限制，总大小不受限制；双方各自最多有STREAM_WINDOW块未被对端消费
+write与read在额度不足或没有数据时阻塞，不能在io线程中调用，处理函数应将句柄交给其他线程使用
+*/
+class stream_handle{
+private:
+    std::shared_ptr<stream_state> state_;
+
+    void send(buffer_type && data, frame_type type) const;
+public:
+    stream_handle() = default;
+    stream_handle(Connection* conn, uint64_t req_id);
+
+    int64_t conn_id() const;
+    uint64_t req_id() const;
+    /*
+    @brief 连接是否已经关闭或释放
+    */
+    bool expired() const;
+    /*
+    @brief 向客户端推送一块数据 参数会被打包为一个元组
+    @return 连接已关闭或已回复最终结果时返回false
+    */
+    template<typename... Args>
+    bool write(Args&&... args) const{
+        if(!state_ || !state_->acquire_credit()) return false;
+        buffer_type buffer = buffer_pool::acquire();
+        msgpack::pack(buffer, std::forward_as_tuple(std::forward<Args>(args)...));
+        if(buffer.size() >= MAX_BUF_LEN){
+            buffer_pool::release(std::move(buffer));
+            throw std::length_error("stream chunk is out of range");
+        }
+        send(std::move(buffer), frame_type::stream_chunk);
+        return true;
+    }
+    /*
+    @brief 读取客户端上传的一块数据 为客户端打包后的原始数据
+    @return 客户端已结束上传或连接已关闭时返回false
+    */
+    bool read(std::string & chunk) const;
+    /*
+    @brief 读取客户端上传的一块数据并解码为T
+    */
+    template<typename T>
+    bool read(T & value) const{
+        std::string chunk;
+        if(!read(chunk)) return false;
+        msgpack_codec codec;
+        value = std::get<0>(codec.unpack<std::tuple<T>>(chunk.data(), chunk.size()));
+        return true;
+    }
+    /*
+    @brief 回复最终结果并结束流 参数会与result_code::OK一同打包
+    */
+    template<typename... Args>
+    void response(Args&&... args) const{
+        buffer_type buffer = buffer_pool::acquire();
+        msgpack_codec::pack_args_to(buffer, result_code::OK, std::forward<Args>(args)...);
+        send(std::move(buffer), frame_type::stream_end);
+    }
+    /*
+    @brief 回复错误信息并结束流
+    */
+    void error(const std::string & msg) const{
+        buffer_type buffer = buffer_pool::acquire();
+        msgpack_codec::pack_args_to(buffer, result_code::FAIL, msg);
+        send(std::move(buffer), frame_type::stream_end);
+    }
+};
+}
+}
+#endif
@@ -0,0 +1,62 @@
+#ifndef TIMER_WHEEL
+#define TIMER_WHEEL
+
+#include <array>
+#include <chrono>
+#include <functional>
+#include <boost/asio.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/noncopyable.hpp>
+
+namespace easy_rpc{
+namespace rpc_server{
+/*
+@brief 分层时间轮 每个io线程一个，只能在其所属io_service的线程中使用
+第0层256个槽，每槽一个tick；其余3层各64个槽，每层槽的跨度是下一层整圈的长度
+定时节点侵入式地挂在槽的链表上，加入、取消、延后都是O(1)且不分配内存，整个时间轮只占用一个asio定时器
+*/
+class timer_wheel : private boost::noncopyable{
+public:
+    /*
+    @brief 定时节点 由使用者持有，回调在节点的生命周期内设置一次
+    节点释放前必须先取消
+    */
+    struct node{
+        node* prev = nullptr;
+        node* next = nullptr;
+        uint64_t deadline = 0; //到期的tick
+        std::function<void()> callback;
+        bool linked() const{ return next != nullptr; }
+    };
+
+    timer_wheel(boost::asio::io_service& io_service, uint32_t tick_ms = 100);
+    void schedule(node& n, uint64_t delay_ms);
+    void cancel(node& n);
+    uint64_t now() const;
+    uint32_t tick_ms() const;
+private:
+    static const int ROOT_BITS = 8;
+    static const int LEVEL_BITS = 6;
+    static const int LEVELS = 3;
+    static const size_t ROOT_SIZE = 1 << ROOT_BITS;
+    static const size_t LEVEL_SIZE = 1 << LEVEL_BITS;
+
+    std::array<node,ROOT_SIZE> root_; //第0层 每个元素是槽链表的哨兵
+    std::array<std::array<node,LEVEL_SIZE>,LEVELS> levels_; //第1~3层
+    boost::asio::steady_timer timer_;
+    std::chrono::steady_clock::time_point start_; //时间轮的起始时刻 用于计算真实的tick
+    uint64_t current_tick_ = 0;
+    uint32_t tick_ms_;
+    size_t count_ = 0; //已挂载的节点数 为0时停止驱动定时器
+    bool running_ = false;
+
+    uint64_t real_tick() const;
+    void add(node& n);
+    void unlink(node& n);
+    void cascade(int level, size_t index);
+    void run_tick();
+    void arm();
+};
+}
+}
+#endif
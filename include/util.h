@@ -1,8 +1,10 @@
 #ifndef UTIL
 #define UTIL
 #include <cstddef>
+#include <cstdint>
 #include <tuple>
 #include <string>
+#include <string_view>
 #include <memory>
 #include <type_traits>
 #include <functional>
@@ -29,12 +31,14 @@ namespace easy_rpc{
         static const std::size_t arity = sizeof...(Args) + 1; // 修正：必须声明为 static const
         typedef Ret function_type(Arg, Args...);
         typedef Ret return_type;
+        typedef Arg first_arg_type;
         using stl_function_type = std::function<function_type>;
         typedef Ret(*pointer)(Arg, Args...);
         typedef std::tuple<Arg, Args...> tuple_type;
         typedef std::tuple<Arg, std::remove_const_t<std::remove_reference_t<Args>>...> bare_tuple_type;
         using args_tuple = std::tuple<std::string, Arg, std::remove_const_t<std::remove_reference_t<Args>>...>;
-        using args_tuple_2nd = std::tuple<std::string, std::remove_const_t<std::remove_reference_t<Args>>...>;
+        //除第一个参数(连接)外的参数 请求解码时在前面加上服务id/名称所在的元素
+        using args_tuple_2nd = std::tuple<std::remove_const_t<std::remove_reference_t<Args>>...>;
     };
 
     template<typename Ret, typename... Args>
@@ -80,6 +84,19 @@ namespace easy_rpc{
         detail::tuple_switch(i, std::forward<Tuple>(t), std::forward<F>(f),std::make_index_sequence<N>{});
     }
 
+    /*
+    @brief 由服务名称计算服务id (32位FNV-1a) 服务端与客户端各自计算，结果一致，无需额外协商
+    constexpr函数 对字符串字面量可以在编译期求值
+    */
+    constexpr uint32_t method_id(std::string_view name){
+        uint32_t hash = 2166136261u;
+        for(char c : name){
+            hash ^= (uint8_t)c;
+            hash *= 16777619u;
+        }
+        return hash;
+    }
+
     template<size_t N, typename... Args>
     using nth_type_of = std::tuple_element_t<N,std::tuple<Args...>>;
     template<typename... Args>
@@ -0,0 +1,40 @@
+#ifndef WORKERPOOL
+#define WORKERPOOL
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <boost/noncopyable.hpp>
+
+namespace easy_rpc{
+namespace rpc_server{
+/*
+@brief 计算线程池 用于执行耗时的处理函数，使其不占用io_pool中负责网络收发的线程
+任务队列有上限，队列满时拒绝新任务，由调用方决定如何处理(一般直接回复服务繁忙)
+线程池停止时尚未执行的任务不再执行，改为调用其提交时给出的拒绝函数(一般回复错误)
+*/
+class worker_pool : private boost::noncopyable{
+private:
+    std::vector<std::thread> threads_; //工作线程
+    struct task_t{
+        std::function<void()> run;
+        std::function<void()> reject; //停止时未执行则调用 可为空
+    };
+    std::deque<task_t> tasks_; //待执行的任务
+    std::mutex mtx_;
+    std::condition_variable cond_;
+    size_t max_queue_; //任务队列上限
+    bool stop_ = false;
+
+    void loop();
+public:
+    worker_pool(size_t pool_size, size_t max_queue);
+    ~worker_pool();
+    bool try_post(std::function<void()> task, std::function<void()> reject = nullptr);
+    void stop();
+};
+}
+}
+#endif
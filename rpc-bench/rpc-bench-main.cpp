@@ -0,0 +1,76 @@
+#include <chrono>
+#include <cstdio>
+#include "rpc-server.h"
+using namespace easy_rpc;
+using namespace rpc_server;
+
+/*
+Router分发开销的微基准
+1. 调用机制对比: 旧实现的 std::bind + std::function(带ExecMode输出参数)
+   与现在Router中的 函数指针 + 上下文指针，两者解码同一个已反序列化的请求，
+   结果都打包进同一种复用的buffer，只比较分发本身的开销
+2. Router::route 端到端: 从请求体到回调拿到回复，包括一次反序列化、按服务id分发和结果打包
+*/
+static const size_t ITERATIONS = 2000000;
+
+int add(Connection* conn, int a, int b){
+    return a + b;
+}
+
+//请求的第一个元素为服务id 与Router一样只保留引用
+typedef std::tuple<msgpack::object,int,int> add_args;
+
+//旧实现: 静态函数模板经std::bind绑定处理函数与占位符后存入std::function
+struct legacy_invoker{
+    static void apply(int(*f)(Connection*,int,int),Connection* conn,uint64_t req_id,const msgpack::object& args,buffer_type& result,ExecMode& mode){
+        mode = ExecMode::sync;
+        auto tp = msgpack_codec::as<add_args>(args);
+        msgpack_codec::pack_args_to(result,result_code::OK,f(conn,std::get<1>(tp),std::get<2>(tp)));
+    }
+};
+
+template<typename F>
+double measure(F&& f){
+    auto begin = std::chrono::steady_clock::now();
+    for(size_t i=0;i<ITERATIONS;i++) f(i);
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double,std::nano>(end - begin).count() / ITERATIONS;
+}
+
+int main(){
+    auto request = msgpack_codec::pack_args(method_id("add"), 1, 2);
+    msgpack_codec codec;
+    const msgpack::object& args = codec.unpack_ref(request.data(), request.size());
+
+    buffer_type out(msgpack_codec::init_size);
+
+    std::function<void(Connection*,uint64_t,const msgpack::object&,buffer_type&,ExecMode&)> legacy =
+        std::bind(&legacy_invoker::apply,&add,std::placeholders::_1,std::placeholders::_2,std::placeholders::_3,std::placeholders::_4,std::placeholders::_5);
+    double legacy_ns = measure([&](size_t i){
+        ExecMode mode;
+        out.clear();
+        legacy(nullptr,i,args,out,mode);
+    });
+
+    int(*add_ptr)(Connection*,int,int) = &add;
+    bool(*invoke)(const void*,Connection*,uint64_t,const msgpack::object&,buffer_type&) = &Router::invoker_of<decltype(&add)>::apply;
+    double fn_ns = measure([&](size_t i){
+        out.clear();
+        invoke(&add_ptr,nullptr,i,args,out);
+    });
+
+    printf("dispatch  std::bind + std::function : %8.1f ns/call\n", legacy_ns);
+    printf("dispatch  function pointer + ctx    : %8.1f ns/call\n", fn_ns);
+
+    size_t replies = 0;
+    Router& router = Router::get();
+    router.register_handler<ExecMode::sync>("add", add);
+    router.set_callback([&replies](std::string_view, buffer_type&& result, Connection*, uint64_t, bool){
+        replies++;
+        buffer_pool::release(std::move(result));
+    });
+    double route_ns = measure([&](size_t i){
+        router.route<Connection*>(request.data(), request.size(), nullptr, i);
+    });
+    printf("Router::route end to end            : %8.1f ns/call (%zu replies)\n", route_ns, replies);
+}
@@ -0,0 +1,92 @@
+#include "rpc-client.h"
+#include "rpc-client-pool.h"
+using namespace easy_rpc;
+
+int main(){
+    rpc_client client("127.0.0.1", 9870);
+    client.set_connect_timeout(3);
+    client.set_wait_timeout(5);
+    if(!client.connect()){
+        std::cout << "connect timeout" << std::endl;
+        return -1;
+    }
+    try{
+        //同步调用
+        client.call("hello", std::string("easy_rpc"));
+        std::cout << client.call<std::string>("get_person_info") << std::endl;
+        std::cout << "fib(50) = " << client.call<long long>("fib", 50) << std::endl;
+
+        //异步调用 多个调用同时在途 回复按完成顺序到达
+        std::vector<std::future<req_result>> futures;
+        for(int i=0;i<10;i++){
+            futures.push_back(client.async_call("delay_echo", "echo " + std::to_string(i)));
+        }
+        for(auto &f : futures){
+            std::cout << f.get().as<std::string>() << std::endl;
+        }
+        //截止时间随请求发送 服务端判断剩余时间不足后直接回复错误
+        std::cout << client.async_call_for(std::chrono::milliseconds(50), "delay_echo", "late").get().success() << std::endl;
+
+        //回调方式的异步调用 回调在io线程中执行
+        std::promise<void> done;
+        client.async_callback([&done](const boost::system::error_code& ec, string_view data){
+            if(!ec) std::cout << "count_bytes: " << get_result<size_t>(data) << std::endl;
+            done.set_value();
+        }, "count_bytes", std::string(1024, 'x'));
+        done.get_future().wait();
+
+        //批量调用
+        rpc_batch batch;
+        for(int i=1;i<=5;i++) batch.add("fib", i * 10);
+        auto batch_res = client.async_batch(batch).get();
+        for(size_t i=0;i<batch_res.size();i++){
+            std::cout << "batch[" << i << "] = " << batch_res.as<long long>(i) << std::endl;
+        }
+
+        //流式下载
+        auto download = client.open_stream("download", 100, 64 * 1024);
+        size_t total = 0;
+        std::string chunk;
+        while(download->read(chunk)) total += chunk.size();
+        std::cout << "download " << total << " bytes, " << download->result().as<int>() << " chunks" << std::endl;
+
+        //流式上传
+        auto upload = client.open_stream("upload");
+        for(int i=0;i<100;i++) upload->write(std::string(64 * 1024, 'u'));
+        upload->finish();
+        std::cout << "upload " << upload->result().as<size_t>() << " bytes" << std::endl;
+    }catch(const std::exception& e){
+        std::cout << e.what() << std::endl;
+    }
+    client.stop();
+
+    //连接池 通过服务发现获取服务端地址 每个地址4个连接 共用两个io线程 按未完成请求数选择连接
+    rpc_client_pool pool(2, balance_policy::power_of_two);
+    pool.set_discovery(std::make_shared<file_discovery>("/tmp/easy_rpc.registry"), "demo", 4);
+    std::cout << "pool connected: " << pool.connect() << std::endl;
+    try{
+        std::vector<std::future<req_result>> futures;
+        for(int i=0;i<1000;i++){
+            futures.push_back(pool.async_call("fib", 30));
+        }
+        long long sum = 0;
+        for(auto &f : futures) sum += f.get().as<long long>();
+        std::cout << "pool sum: " << sum << std::endl;
+
+        //对冲请求 主调用50毫秒内没有结果时再发一个备份调用 取先到的结果并取消另一个
+        auto primary = pool.start_call("delay_echo", std::string("hedge"));
+        if(primary.result.wait_for(std::chrono::milliseconds(50)) != std::future_status::ready){
+            auto backup = pool.start_call("delay_echo", std::string("hedge"));
+            while(primary.result.wait_for(std::chrono::milliseconds(1)) != std::future_status::ready &&
+                backup.result.wait_for(std::chrono::milliseconds(1)) != std::future_status::ready){}
+            bool primary_done = primary.result.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+            (primary_done ? backup : primary).cancel();
+            if(!primary_done) primary = std::move(backup);
+        }
+        std::cout << "hedged: " << primary.result.get().as<std::string>() << std::endl;
+    }catch(const std::exception& e){
+        std::cout << e.what() << std::endl;
+    }
+    pool.stop();
+    return 0;
+}
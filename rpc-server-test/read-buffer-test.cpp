@@ -0,0 +1,213 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "read_buffer.h"
+using namespace easy_rpc;
+using namespace easy_rpc::rpc_server;
+
+/*
+@brief read_buffer与消息头的自检程序 覆盖消息头的编解码、缓冲区末尾不完整的消息头、超过块大小的消息，
+以及block_pool的大小级别、缓冲区搬移与换用大块、全部解析完后归还大块
+全部检查通过时返回0
+*/
+static int failures = 0;
+#define CHECK(cond) do{ if(!(cond)){ std::printf("FAILED: %s (line %d)\n", #cond, __LINE__); failures++; } }while(0)
+
+/*
+@brief 按连接读取的方式写入数据 空闲空间不足时先预留
+*/
+static void feed(read_buffer& buf, const std::string& bytes){
+    size_t offset = 0;
+    while(offset < bytes.size()){
+        if(buf.tail_size() == 0) buf.reserve(buf.size() + 1);
+        size_t n = std::min(buf.tail_size(), bytes.size() - offset);
+        memcpy(buf.tail(), bytes.data() + offset, n);
+        buf.commit(n);
+        offset += n;
+    }
+}
+/*
+@brief 打包一个完整的消息
+*/
+static std::string frame(frame_type type, uint64_t req_id, const std::string& body){
+    char head[HEAD_LEN];
+    encode_head(head, type, (uint32_t)body.size(), req_id);
+    return std::string(head, HEAD_LEN) + body;
+}
+/*
+@brief 与Connection::parse相同的解析循环 返回解析出的全部消息体
+*/
+static std::vector<std::string> parse(read_buffer& buf){
+    std::vector<std::string> bodies;
+    frame_head head;
+    while(buf.peek_head(head)){
+        if(buf.size() < HEAD_LEN + head.body_len){
+            buf.reserve(HEAD_LEN + head.body_len);
+            break;
+        }
+        bodies.emplace_back(buf.data() + HEAD_LEN, head.body_len);
+        buf.consume(HEAD_LEN + head.body_len);
+    }
+    buf.reserve(HEAD_LEN);
+    return bodies;
+}
+
+static void test_head_round_trip(){
+    const frame_type types[] = {frame_type::call, frame_type::batch, frame_type::stream_chunk,
+        frame_type::stream_end, frame_type::credit, frame_type::cancel};
+    const uint32_t lengths[] = {0, 1, DEADLINE_LEN, (uint32_t)MAX_BUF_LEN - 1};
+    const uint64_t ids[] = {0, 1, 0x0123456789abcdefull, ~0ull};
+    for(auto type : types){
+        for(uint32_t len : lengths){
+            for(uint64_t id : ids){
+                for(bool deadline : {false, true}){
+                    char head[HEAD_LEN];
+                    encode_head(head, type, len, id, deadline);
+                    frame_head h = decode_head(head);
+                    CHECK(h.type == type);
+                    CHECK(h.body_len == len);
+                    CHECK(h.req_id == id);
+                    CHECK(h.has_deadline == deadline);
+                }
+            }
+        }
+    }
+    //旧客户端的消息头 类型字节为0
+    char head[HEAD_LEN];
+    uint32_t len = 42;
+    uint64_t id = 7;
+    memcpy(head, &len, sizeof(len));
+    memcpy(head + sizeof(len), &id, sizeof(id));
+    frame_head h = decode_head(head);
+    CHECK(h.type == frame_type::call && h.body_len == 42 && h.req_id == 7 && !h.has_deadline);
+}
+
+static void test_partial_head(){
+    read_buffer buf;
+    std::string first = frame(frame_type::call, 1, "hello");
+    std::string second = frame(frame_type::batch, 2, "world!");
+    //一次读取包含一个完整的消息与下一个消息头的前5个字节
+    feed(buf, first + second.substr(0, 5));
+    auto bodies = parse(buf);
+    CHECK(bodies.size() == 1 && bodies[0] == "hello");
+    CHECK(buf.size() == 5);
+    frame_head head;
+    CHECK(!buf.peek_head(head));
+    //消息头余下的部分与消息体分两次到达
+    feed(buf, second.substr(5, HEAD_LEN - 5));
+    CHECK(parse(buf).empty());
+    CHECK(buf.peek_head(head) && head.type == frame_type::batch && head.req_id == 2);
+    feed(buf, second.substr(HEAD_LEN));
+    bodies = parse(buf);
+    CHECK(bodies.size() == 1 && bodies[0] == "world!");
+    CHECK(buf.size() == 0);
+}
+
+static void test_frame_larger_than_block(){
+    read_buffer buf;
+    std::string body(3 * block_pool::min_block + 17, '\0');
+    for(size_t i = 0; i < body.size(); i++) body[i] = (char)(i * 31);
+    std::string bytes = frame(frame_type::call, 9, body) + frame(frame_type::call, 10, "tail");
+    //按最小块的大小分多次到达
+    std::vector<std::string> bodies;
+    for(size_t offset = 0; offset < bytes.size(); offset += block_pool::min_block / 2){
+        feed(buf, bytes.substr(offset, block_pool::min_block / 2));
+        for(auto &b : parse(buf)) bodies.push_back(b);
+    }
+    CHECK(bodies.size() == 2 && bodies[0] == body && bodies[1] == "tail");
+    CHECK(buf.size() == 0);
+}
+
+static void test_block_classes(){
+    size_t capacity;
+    char* block = block_pool::acquire(1, capacity);
+    CHECK(capacity == block_pool::min_block);
+    block_pool::release(block, capacity);
+    block = block_pool::acquire(block_pool::min_block + 1, capacity);
+    CHECK(capacity == 2 * block_pool::min_block);
+    block_pool::release(block, capacity);
+    //归还的块按大小级别缓存 再次取出同一级别时复用
+    char* again = block_pool::acquire(2 * block_pool::min_block, capacity);
+    CHECK(again == block && capacity == 2 * block_pool::min_block);
+    block_pool::release(again, capacity);
+    //超过最大级别的块按实际大小分配 不缓存
+    size_t largest = block_pool::min_block << (block_pool::class_count - 1);
+    block = block_pool::acquire(largest + 1, capacity);
+    CHECK(capacity == largest + 1);
+    block_pool::release(block, capacity);
+}
+/*
+@brief 缓冲区所在块的末尾与容量 read_buffer不公开块的地址，由未解析数据与空闲空间推算
+*/
+static const char* block_end(read_buffer& buf){
+    return buf.tail() + buf.tail_size();
+}
+
+static void test_compact_and_grow(){
+    read_buffer buf;
+    size_t capacity = buf.size() + buf.tail_size();
+    CHECK(capacity == block_pool::min_block);
+    //填满整个块 消费掉前面的部分后只剩不完整的消息
+    std::string bytes(capacity, 'x');
+    for(size_t i = 0; i < bytes.size(); i++) bytes[i] = (char)i;
+    feed(buf, bytes);
+    CHECK(buf.tail_size() == 0);
+    size_t consumed = capacity - 100;
+    buf.consume(consumed);
+    const char* end = block_end(buf);
+
+    //剩余数据加上新消息仍能放进当前块 搬移到块的头部而不换块
+    buf.reserve(200);
+    CHECK(block_end(buf) == end);
+    CHECK(buf.size() == 100 && buf.data() == end - capacity);
+    CHECK(memcmp(buf.data(), bytes.data() + consumed, 100) == 0);
+    CHECK(buf.tail_size() == capacity - 100);
+
+    //需要的长度超过块的大小 换用更大的块 只复制未解析的数据
+    buf.reserve(3 * block_pool::min_block);
+    CHECK(block_end(buf) != end);
+    CHECK(buf.size() == 100);
+    CHECK(buf.size() + buf.tail_size() >= 3 * block_pool::min_block);
+    CHECK(memcmp(buf.data(), bytes.data() + consumed, 100) == 0);
+}
+
+static void test_large_block_returned(){
+    read_buffer buf;
+    std::string body(5 * block_pool::min_block, 'b');
+    std::string bytes = frame(frame_type::call, 1, body);
+    //先只收到消息头 解析时按消息长度换用大块
+    feed(buf, bytes.substr(0, HEAD_LEN));
+    CHECK(parse(buf).empty());
+    size_t large = buf.size() + buf.tail_size();
+    CHECK(large > block_pool::min_block);
+    const char* large_block = buf.data();
+    feed(buf, bytes.substr(HEAD_LEN));
+    //全部解析完后大块立即归还 缓冲区换回最小的块
+    auto bodies = parse(buf);
+    CHECK(bodies.size() == 1 && bodies[0] == body);
+    CHECK(buf.size() == 0);
+    CHECK(buf.size() + buf.tail_size() == block_pool::min_block);
+    //归还的大块留在本线程的缓存中 下一次取同样大小的块时复用
+    size_t capacity;
+    char* block = block_pool::acquire(large, capacity);
+    CHECK(block == large_block && capacity == large);
+    block_pool::release(block, capacity);
+    //clear后不再持有任何块 再次使用时重新取块
+    buf.clear();
+    CHECK(buf.size() == 0 && buf.tail_size() == 0);
+    buf.reserve(HEAD_LEN);
+    CHECK(buf.tail_size() == block_pool::min_block);
+}
+
+int main(){
+    test_head_round_trip();
+    test_partial_head();
+    test_frame_larger_than_block();
+    test_block_classes();
+    test_compact_and_grow();
+    test_large_block_returned();
+    if(failures == 0) std::printf("read buffer: all checks passed\n");
+    return failures == 0 ? 0 : 1;
+}
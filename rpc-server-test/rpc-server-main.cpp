@@ -6,6 +6,59 @@ void hello(Connection* conn,const std::string & str){
     std::cout << "Hello " << str << std::endl;
 }
 
+//string_view参数直接指向请求缓冲区 大块数据不发生复制
+size_t count_bytes(Connection* conn,std::string_view data){
+    return data.size();
+}
+
+//异步处理函数 在其他线程中完成耗时操作后通过句柄回复 不阻塞io线程
+void delay_echo(response_handle rsp,const std::string & str){
+    std::thread([rsp,str]{
+        //剩余时间不足以完成时直接放弃
+        if(rsp.remaining() < std::chrono::milliseconds(100)){
+            rsp.error("not enough time left");
+            return;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        if(rsp.cancelled()) return; //客户端已取消 不必回复
+        rsp.response(str);
+    }).detach();
+}
+
+//流式调用 分块推送count块数据 每块受额度控制 总大小不受MAX_BUF_LEN限制
+void download(stream_handle stream,int count,int chunk_size){
+    std::thread([stream,count,chunk_size]{
+        std::string chunk(chunk_size,'x');
+        for(int i=0;i<count;i++){
+            if(!stream.write(chunk)) return; //连接已断开
+        }
+        stream.response(count);
+    }).detach();
+}
+
+//流式上传 逐块读取客户端上传的数据 上传结束后回复总字节数
+void upload(stream_handle stream){
+    std::thread([stream]{
+        size_t total = 0;
+        std::string chunk;
+        while(stream.read(chunk)){
+            total += chunk.size();
+        }
+        stream.response(total);
+    }).detach();
+}
+
+//计算密集的处理函数 交给计算线程池执行
+long long fib(Connection* conn,int n){
+    long long a = 0, b = 1;
+    for(int i=0;i<n;i++){
+        long long t = a + b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
 class Person{
 private:
     int id;
@@ -23,9 +76,18 @@ public:
 };
 int main(){
     RpcServer server(9870,5);
+    server.set_worker_pool(4);
+    server.set_reuse_port(true);
+    //通过本地文件注册 客户端连接池据此发现本服务端
+    server.set_discovery(std::make_shared<file_discovery>("/tmp/easy_rpc.registry"), "demo", "127.0.0.1");
     Person p(1, "amston", 25);
     server.register_handler<ExecMode::sync>("get_person_info", &Person::get_person_info, &p);
     server.register_handler<ExecMode::sync>("hello", hello);
+    server.register_handler<ExecMode::sync>("count_bytes", count_bytes);
+    server.register_handler<ExecMode::async>("delay_echo", delay_echo);
+    server.register_handler<ExecMode::sync,ExecPolicy::offload>("fib", fib);
+    server.register_handler<ExecMode::stream>("download", download);
+    server.register_handler<ExecMode::stream>("upload", upload);
     server.run();
     getchar();
 }
\ No newline at end of file
@@ -0,0 +1,65 @@
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+#include "timer_wheel.h"
+using namespace easy_rpc::rpc_server;
+
+/*
+@brief timer_wheel的自检程序 覆盖加入、延后、提前、取消、回调中重新调度与高层槽的级联
+全部检查通过时返回0
+*/
+static int failures = 0;
+#define CHECK(cond) do{ if(!(cond)){ std::printf("FAILED: %s (line %d)\n", #cond, __LINE__); failures++; } }while(0)
+
+int main(){
+    //看门狗 节点计数出错时时间轮会一直驱动定时器 io_service不会返回
+    std::thread([]{
+        std::this_thread::sleep_for(std::chrono::seconds(10));
+        std::printf("FAILED: timer wheel never became idle\n");
+        std::fflush(stdout);
+        std::_Exit(1);
+    }).detach();
+
+    boost::asio::io_service ios;
+    timer_wheel wheel(ios, 1);
+    auto start = std::chrono::steady_clock::now();
+    auto elapsed = [&start]{
+        return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+    };
+    std::vector<std::string> fired;
+    timer_wheel::node a, b, c, d, e;
+    a.callback = [&]{ fired.push_back("a"); CHECK(elapsed() >= 100); };
+    b.callback = [&]{ fired.push_back("b"); CHECK(elapsed() >= 20); CHECK(elapsed() < 200); };
+    c.callback = [&]{ fired.push_back("c"); };
+    d.callback = [&]{ fired.push_back("d"); CHECK(elapsed() >= 600); }; //超出第0层的跨度 经过级联后到期
+    e.callback = [&]{
+        fired.push_back("e");
+        if(fired.size() == 1) wheel.schedule(e, 10); //回调中重新调度
+    };
+
+    wheel.schedule(a, 50);
+    wheel.schedule(b, 200);
+    wheel.schedule(c, 30);
+    wheel.schedule(d, 600);
+    wheel.schedule(e, 5);
+    wheel.cancel(c);
+    wheel.cancel(c); //重复取消无影响
+    wheel.schedule(a, 100); //延后
+    wheel.schedule(b, 20); //提前
+    ios.run();
+
+    std::vector<std::string> expected{"e", "e", "b", "a", "d"};
+    CHECK(fired == expected);
+    CHECK(!a.linked() && !b.linked() && !c.linked() && !d.linked() && !e.linked());
+
+    //时间轮空闲后再次调度
+    wheel.schedule(c, 10);
+    ios.restart();
+    ios.run();
+    CHECK(!fired.empty() && fired.back() == "c");
+
+    if(failures == 0) std::printf("timer wheel: all checks passed\n");
+    return failures == 0 ? 0 : 1;
+}
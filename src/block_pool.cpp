@@ -0,0 +1,53 @@
+#include "block_pool.h"
+#include <vector>
+#include <memory>
+
+namespace easy_rpc{
+namespace rpc_server{
+namespace{
+    struct local_blocks{
+        std::vector<std::unique_ptr<char[]>> free_list[block_pool::class_count];
+        size_t cached_bytes = 0;
+    };
+    local_blocks& local_cache(){
+        thread_local local_blocks cache;
+        return cache;
+    }
+    //size所属的大小级别
+    size_t class_of(size_t size){
+        size_t index = 0;
+        while(index + 1 < block_pool::class_count && (block_pool::min_block << index) < size) index++;
+        return index;
+    }
+}
+
+char* block_pool::acquire(size_t size, size_t& capacity){
+    size_t index = class_of(size);
+    capacity = min_block << index;
+    if(capacity < size){
+        //超过最大级别的块不缓存
+        capacity = size;
+        return new char[size];
+    }
+    auto &cache = local_cache();
+    auto &list = cache.free_list[index];
+    if(list.empty()) return new char[capacity]; //不做值初始化 避免清零即将被覆盖的内存
+    char* block = list.back().release();
+    list.pop_back();
+    cache.cached_bytes -= capacity;
+    return block;
+}
+
+void block_pool::release(char* block, size_t capacity){
+    if(!block) return;
+    size_t index = class_of(capacity);
+    auto &cache = local_cache();
+    if((min_block << index) != capacity || cache.cached_bytes + capacity > max_cached_bytes){
+        delete[] block;
+        return;
+    }
+    cache.free_list[index].emplace_back(block);
+    cache.cached_bytes += capacity;
+}
+}
+}
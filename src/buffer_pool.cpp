@@ -0,0 +1,63 @@
+#include "buffer_pool.h"
+#include <vector>
+#include <mutex>
+
+namespace easy_rpc{
+namespace rpc_server{
+namespace{
+    std::vector<buffer_type>& local_cache(){
+        thread_local std::vector<buffer_type> cache;
+        return cache;
+    }
+    /*
+    @brief 所有线程共享的空闲列表 每次交换半个线程缓存的buffer，加锁的次数远少于取用与归还的次数
+    */
+    struct shared_list{
+        std::mutex mtx;
+        std::vector<buffer_type> buffers;
+    };
+    shared_list& shared(){
+        static shared_list list;
+        return list;
+    }
+}
+/*
+@brief 取出一个空的buffer 本线程没有缓存时先从共享空闲列表补充，仍没有时新分配
+*/
+buffer_type buffer_pool::acquire(){
+    auto &cache = local_cache();
+    if(cache.empty()){
+        auto &list = shared();
+        std::lock_guard<std::mutex> lock(list.mtx);
+        if(cache.capacity() == 0) cache.reserve(max_cached);
+        while(!list.buffers.empty() && cache.size() < max_cached / 2){
+            cache.push_back(std::move(list.buffers.back()));
+            list.buffers.pop_back();
+        }
+    }
+    if(cache.empty()) return buffer_type(msgpack_codec::init_size);
+    buffer_type buffer(std::move(cache.back()));
+    cache.pop_back();
+    return buffer;
+}
+/*
+@brief 归还buffer到当前线程的缓存 缓存已满时将一半移入共享空闲列表，供只取用不归还的线程使用
+*/
+void buffer_pool::release(buffer_type && buffer){
+    if(buffer.size() > max_cached_size) return;
+    auto &cache = local_cache();
+    if(cache.size() >= max_cached){
+        auto &list = shared();
+        std::lock_guard<std::mutex> lock(list.mtx);
+        while(cache.size() > max_cached / 2 && list.buffers.size() < max_shared){
+            list.buffers.push_back(std::move(cache.back()));
+            cache.pop_back();
+        }
+        if(cache.size() >= max_cached) return; //共享列表也已满
+    }
+    buffer.clear();
+    if(cache.capacity() == 0) cache.reserve(max_cached);
+    cache.push_back(std::move(buffer));
+}
+}
+}
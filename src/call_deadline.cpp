@@ -0,0 +1,27 @@
+#include "call_deadline.h"
+
+namespace easy_rpc{
+namespace rpc_server{
+namespace{
+    thread_local deadline_type current_deadline = no_deadline;
+}
+
+deadline_type call_deadline::current(){
+    return current_deadline;
+}
+
+std::chrono::milliseconds call_deadline::remaining(deadline_type deadline){
+    if(deadline == no_deadline) return std::chrono::milliseconds::max();
+    auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+    return left.count() > 0 ? left : std::chrono::milliseconds(0);
+}
+
+call_deadline::scope::scope(deadline_type deadline):prev_(current_deadline){
+    current_deadline = deadline;
+}
+
+call_deadline::scope::~scope(){
+    current_deadline = prev_;
+}
+}
+}
@@ -0,0 +1,23 @@
+#include "cancel_token.h"
+
+namespace easy_rpc{
+namespace rpc_server{
+namespace{
+    thread_local std::shared_ptr<std::atomic_bool> current_flag;
+}
+
+cancel_token cancel_token::current(){
+    cancel_token token;
+    token.flag_ = current_flag;
+    return token;
+}
+
+cancel_token::scope::scope(const cancel_token& token):prev_(std::move(current_flag)){
+    current_flag = token.flag_;
+}
+
+cancel_token::scope::~scope(){
+    current_flag = std::move(prev_);
+}
+}
+}
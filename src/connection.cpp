@@ -2,21 +2,30 @@
 
 namespace easy_rpc{
 namespace rpc_server{
-Connection::Connection(boost::asio::io_service& io_service,std::size_t timeout_seconds):
-socket_(io_service),
-body_(INIT_BUF_SIZE),
-timer_(io_service),
+Connection::Connection(io_worker& worker,std::size_t timeout_seconds):
+worker_(worker),
+io_service_(worker.io_service),
+socket_(worker.io_service),
 timeout_seconds_(timeout_seconds),
-has_closed_(false){}
+has_closed_(false){
+    timer_.callback = [this]{on_timeout();};
+    write_buffers_.reserve(2 * MAX_WRITE_FRAMES);
+}
 
 Connection::~Connection(){
+    close_callback_ = nullptr; //析构时连接已不在连接表中 无需注销
     close(); 
+    worker_.pending -= pending_; //连接释放时仍未回复的请求不再计入负载
 }
 /*
 @brief 开始一个连接 读取数据
 */
 void Connection::start(){
-    read_head();
+    started_ = true;
+    worker_.connections++;
+    //接受连接的线程可能不是本连接的io线程 时间轮等状态只能在io线程中访问
+    auto self = this->shared_from_this();
+    io_service_.dispatch([this,self]{read();});
 }
 /*
 @brief 获取socket
@@ -31,60 +40,173 @@ bool Connection::has_closed() const{
     return has_closed_;
 }
 /*
-@brief 异步回复
+@brief 异步回复 回复可能来自任意线程，统一转到本连接的io线程中入队，保证outbox_只在一个线程中访问
+@param req_id 回复对应的请求id
 @param data 回复的内容
+@param type 消息类型 流式调用的数据块与额度消息不是最终回复，不减少未回复的请求数
 */
-void Connection::response(string data){
-    int datalen = data.size();
-    assert(datalen < MAX_BUF_LEN);
-    //创建三个写缓冲区
-    array<boost::asio::const_buffer,3> write_buffers;
-    write_msg_ = move(data);
-    //第一个缓冲区放入数据长度，第二个缓冲区放入请求id作为唯一标识，第三个缓冲区放入回复的信息
-    write_buffers[0] = boost::asio::buffer(&datalen,sizeof(uint32_t));
-    write_buffers[1] = boost::asio::buffer(&req_id_,sizeof(uint64_t));
-    write_buffers[2] = boost::asio::buffer(write_msg_.data(),datalen);
-    
-    reset_timer();//重置时间
+void Connection::response(uint64_t req_id, buffer_type && data, frame_type type){
+    assert(data.size() < MAX_BUF_LEN);
     auto self = this->shared_from_this();//对本对象创建共享指针，防止在异步未执行完之前销毁
+    boost::asio::dispatch(io_service_,[this,self,req_id,type,data = move(data)]() mutable{
+        bool final_reply = type != frame_type::stream_chunk && type != frame_type::credit;
+        if(final_reply && pending_ > 0){
+            pending_--;
+            worker_.pending--;
+        }
+        if(final_reply && !streams_.empty()){
+            streams_.erase(req_id); //流式调用已回复最终结果 之后的数据块直接丢弃
+        }
+        if(final_reply && !cancels_.empty()){
+            auto it = cancels_.find(req_id);
+            if(it != cancels_.end()) remove_cancel(it);
+        }
+        enqueue(req_id, move(data), type);
+    });
+}
+/*
+@brief 将一条消息放入回复队列 只在io线程中调用
+*/
+void Connection::enqueue(uint64_t req_id, buffer_type && data, frame_type type){
+    if(has_closed()){
+        buffer_pool::release(move(data));
+        return;
+    }
+    outbox_.emplace_back();
+    auto &msg = outbox_.back();
+    encode_head(msg.head,type,(uint32_t)data.size(),req_id);
+    outbox_bytes_ += HEAD_LEN + data.size();
+    msg.data = move(data);
+    //已有写操作在进行或已安排发送 完成后会一并发送队列中的回复
+    if(writing_ > 0 || flush_scheduled_) return;
+    //推迟到本轮事件处理之后再写 使同一批请求的回复合并为一次系统调用
+    flush_scheduled_ = true;
+    auto self = this->shared_from_this();
+    boost::asio::post(io_service_,[this,self]{
+        flush_scheduled_ = false;
+        write();
+    });
+}
+/*
+@brief 将回复队列中的多条回复合并为一次写操作(writev)，数量与字节数都有上限，发送完成后继续发送剩余回复
+每条回复占用两个缓冲区：消息头[数据长度(4 bytes) 请求id(8 bytes)]与回复的信息
+*/
+void Connection::write(){
+    if(writing_ > 0 || outbox_.empty() || has_closed()) return;
+    write_buffers_.clear();
+    size_t bytes = 0;
+    for(auto &msg : outbox_){
+        size_t len = HEAD_LEN + msg.data.size();
+        if(writing_ >= MAX_WRITE_FRAMES || (writing_ > 0 && bytes + len > MAX_WRITE_BYTES)) break;
+        write_buffers_.push_back(boost::asio::buffer(msg.head, HEAD_LEN));
+        write_buffers_.push_back(boost::asio::buffer(msg.data.data(), msg.data.size()));
+        bytes += len;
+        writing_++;
+    }
+
+    auto self = this->shared_from_this();
     //异步回复
     boost::asio::async_write(
-        socket_,write_buffers,
+        socket_,write_buffers_,
         [this,self](boost::system::error_code ec,std::size_t length){
+            for(;writing_ > 0;writing_--){
+                outbox_bytes_ -= HEAD_LEN + outbox_.front().data.size();
+                buffer_pool::release(move(outbox_.front().data));
+                outbox_.pop_front();
+            }
             //如果有错误则退出
             if(ec){
                 cout << ec.value() << " "<<ec.message()<<endl;
                 close(); //写入异常 关闭连接
                 return;
             }
-            cancel_timer();
-            if(has_closed()) return;
-            //写入有效 读取信息
-            if(!ec) read_head();
-            else close();//回复后读取异常 关闭连接
+            write();
+            //客户端已取走足够多的回复 恢复读取请求
+            if(read_paused_ && outbox_bytes_ <= low_watermark_ && !has_closed()){
+                read_paused_ = false;
+                read();
+            }
         }
     );
 }
 /*
+@brief 登记流式调用 由stream_handle在io线程中构造时调用
+*/
+void Connection::add_stream(uint64_t req_id, shared_ptr<stream_state> stream){
+    streams_[req_id] = move(stream);
+}
+/*
+@brief 为请求创建取消标志 由Router在io线程中为offload与async模式的请求调用，回复最终结果后注销
+@param deadline 请求的截止时间 到期时由时间轮设置取消标志，排队中的请求不再执行，正在执行的处理函数可以提前结束
+*/
+cancel_token Connection::add_cancel(uint64_t req_id, deadline_type deadline){
+    auto it = cancels_.find(req_id);
+    if(it != cancels_.end()) remove_cancel(it);
+    cancel_entry &entry = cancels_[req_id];
+    entry.token = cancel_token::create();
+    if(deadline != no_deadline){
+        //回调只捕获表项的指针 可以存放在std::function的内部缓冲区中，不额外分配内存；表项注销前先从时间轮上摘下
+        cancel_entry* target = &entry;
+        entry.timer.callback = [target]{ target->token.cancel(); };
+        worker_.wheel.schedule(entry.timer, call_deadline::remaining(deadline).count());
+    }
+    return entry.token;
+}
+/*
+@brief 注销可取消的请求 先从时间轮上摘下 节点随后释放
+*/
+void Connection::remove_cancel(unordered_map<uint64_t,cancel_entry>::iterator it){
+    worker_.wheel.cancel(it->second.timer);
+    cancels_.erase(it);
+}
+/*
+@brief 客户端取消请求 已回复或没有取消标志的请求直接忽略
+流式调用唤醒阻塞中的读写 处理函数随后回复最终结果结束该流
+*/
+void Connection::cancel(uint64_t req_id){
+    auto it = cancels_.find(req_id);
+    if(it != cancels_.end()){
+        it->second.token.cancel();
+        remove_cancel(it);
+    }
+    auto stream = streams_.find(req_id);
+    if(stream != streams_.end()) stream->second->abort();
+}
+/*
 @brief 设置连接id
 */
 void Connection::set_conn_id(int64_t id){
     conn_id = (size_t)id;
 }
 /*
+@brief 设置连接关闭时的回调 参数为连接id
+*/
+void Connection::set_close_callback(function<void(int64_t)> callback){
+    close_callback_ = move(callback);
+}
+/*
+@brief 设置回复队列的高低水位 需在start之前调用
+@param high 回复队列超过该字节数时暂停读取请求
+@param low 回复队列回落到该字节数以下时恢复读取
+*/
+void Connection::set_watermark(size_t high, size_t low){
+    high_watermark_ = high;
+    low_watermark_ = low < high ? low : high;
+}
+/*
 @brief 获取连接id
 */
 int64_t Connection::get_conn_id(){
     return conn_id;
 }
 /*
-@brief 从socket中读取数据头
+@brief 从socket中读取数据 不按消息边界读取，有多少读多少，读到的数据可能包含多个请求
 */
-void Connection::read_head(){
+void Connection::read(){
     reset_timer();
     shared_ptr<Connection> self(this->shared_from_this());
-    boost::asio::async_read(
-        socket_,boost::asio::buffer(head_),
+    socket_.async_read_some(
+        boost::asio::buffer(read_buf_.tail(),read_buf_.tail_size()),
         /*this：指向当前对象的指针。它允许回调函数直接访问当前对象的成员变量和成员函数
         self：是一个 std::shared_ptr，指向当前对象，并通过 shared_from_this() 获得。
         它的作用是保持当前对象的有效性，确保在异步操作执行期间，该对象不会被销毁。*/
@@ -92,79 +214,143 @@ void Connection::read_head(){
             if(!socket_.is_open()){ //soket已关闭，直接返回
                 return;
             }
-            if(!ec){
-                //没有错误读取数据  [数据长度(4 bytes) 请求id(8 bytes) 数据] head占用12字节
-                const uint32_t body_len = *((int*)(head_));//读取数据长度
-                req_id_ = *((uint64_t*)(head_ + sizeof(int32_t)));
-                if(body_len > 0 && body_len < MAX_BUF_LEN){
-                    if(body_.size() < body_len) {
-                        //数据数组空间不足则扩展空间
-                        body_.resize(body_len);
-                    }
-                    read_body(body_len);
-                    return;
-                }
-                if(body_len == 0){
-                    //空数据包 可能是heartbeat
-                    cancel_timer();
-                    read_head();
-                }else{
-                    close();//获取数据长度小于0 异常关闭连接
-                }
-            }else{
+            if(ec){
                 close(); //读异常 关闭连接
+                return;
             }
+            read_buf_.commit(length);
+            if(!parse()) return;
+            //客户端读取回复过慢 回复堆积超过高水位时暂停读取 不再接收新请求 由write在回落到低水位后恢复
+            if(outbox_bytes_ >= high_watermark_){
+                read_paused_ = true;
+                return;
+            }
+            //不等待回复完成 继续读取后续请求 回复按完成顺序携带req_id返回
+            read();
         }
     );
 }
 /*
-@brief 从socket中读取size大小的数据
+@brief 解析读缓冲区中所有完整的请求并交给Router处理
+消息格式 [数据长度(4 bytes) 请求id(8 bytes) 数据] 不完整的消息留在缓冲区中等待下一次读取
+@return 连接已关闭时返回false
 */
-void Connection::read_body(size_t size){
-    auto self(this->shared_from_this());
-    boost::asio::async_read(
-        socket_,boost::asio::buffer(body_.data(),size),
-        [this,self](boost::system::error_code ec,size_t length){
-            cancel_timer();
-            if(!socket_.is_open()){
-                return;
+bool Connection::parse(){
+    auto begin = chrono::steady_clock::now();
+    size_t routed = 0; //本次解析交给Router的请求数
+    Router & _router = Router::get();
+    frame_head head;
+    while(read_buf_.peek_head(head)){
+        if(head.body_len == 0){
+            //没有数据的消息为取消消息或心跳
+            read_buf_.consume(HEAD_LEN);
+            if(head.type == frame_type::cancel){
+                cancel(head.req_id);
+                continue;
+            }
+            //心跳原样回复一个空数据包 客户端据此判断连接是否仍然可用
+            enqueue(head.req_id, buffer_pool::acquire(), frame_type::call);
+            continue;
+        }
+        if(head.body_len >= MAX_BUF_LEN){
+            close(); //数据长度异常 关闭连接
+            return false;
+        }
+        if(read_buf_.size() < HEAD_LEN + head.body_len){
+            //消息体尚未读完 保证缓冲区能容纳整个消息
+            read_buf_.reserve(HEAD_LEN + head.body_len);
+            break;
+        }
+        const char* body = read_buf_.data() + HEAD_LEN;
+        frame_head frame = head;
+        deadline_type deadline = no_deadline;
+        if(head.has_deadline){
+            //数据以剩余时间(毫秒)开头 以收到本批数据的时间为起点换算为本地的截止时间
+            if(head.body_len < DEADLINE_LEN){
+                close();
+                return false;
             }
-            if(!ec){
-                //获取到数据体 创建Router 匹配命令到需要具体调用的服务
-                Router & _router = Router::get();
-                _router.route(body_.data(),length,this); //结果会自动调用callback返回数据到conn的客户端
+            uint32_t budget_ms;
+            memcpy(&budget_ms,body,DEADLINE_LEN);
+            deadline = begin + chrono::milliseconds(budget_ms);
+            body += DEADLINE_LEN;
+            frame.body_len -= DEADLINE_LEN;
+        }
+        if(head.type == frame_type::call || head.type == frame_type::batch){
+            pending_++;
+            worker_.pending++;
+            routed++;
+            //请求体直接引用读缓冲区 结果会自动调用callback返回数据到conn的客户端
+            if(head.type == frame_type::batch){
+                _router.route_batch(body,frame.body_len,this,head.req_id,deadline);
             }else{
-                return;
+                _router.route(body,frame.body_len,this,head.req_id,deadline);
             }
+        }else if(!on_stream_frame(frame,body)){
+            close(); //未知的消息类型或违反流控 关闭连接
         }
-    );
+        if(has_closed()) return false;
+        read_buf_.consume(HEAD_LEN + head.body_len);
+    }
+    read_buf_.reserve(HEAD_LEN);
+    if(routed){
+        //一次读取可能包含多个请求 按本批的平均耗时计入单个请求的耗时
+        auto elapsed = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - begin).count();
+        worker_.record_busy((uint64_t)elapsed / routed);
+    }
+    return true;
 }
 /*
-@brief 重置计时器
+@brief 处理流式调用中客户端发来的数据块、上传结束与额度消息 对应的流已结束时直接丢弃
+@return 未知的消息类型或客户端超出额度发送数据块时返回false
+*/
+bool Connection::on_stream_frame(const frame_head& head, const char* body){
+    if(head.type != frame_type::stream_chunk && head.type != frame_type::stream_end && head.type != frame_type::credit){
+        return false;
+    }
+    auto it = streams_.find(head.req_id);
+    if(it == streams_.end()) return true;
+    if(head.type == frame_type::stream_chunk){
+        //读缓冲区会被复用 数据块需要复制 不遵守额度的客户端可以让服务端无限缓存数据，视为协议错误
+        if(!it->second->push(string(body,head.body_len))) return false;
+    }else if(head.type == frame_type::stream_end){
+        it->second->end_input();
+    }else if(head.body_len >= sizeof(uint32_t)){
+        uint32_t credits;
+        memcpy(&credits,body,sizeof(uint32_t));
+        it->second->grant(credits);
+    }
+    return true;
+}
+/*
+@brief 重置计时器 只更新时间轮节点的到期时间 不分配内存也不触及asio的定时器
 */
 void Connection::reset_timer(){
-    if(timeout_seconds_ == 0) return;
-    auto self(this->shared_from_this());
-    timer_.expires_from_now(boost::posix_time::seconds((long)timeout_seconds_));
-    timer_.async_wait([this,self](const boost::system::error_code& ec){
-        if(has_closed()) return;
-        if(ec) return;
-        //timeout时间到自动关闭连接
-        close();
-    });
+    if(timeout_seconds_ == 0 || has_closed()) return;
+    worker_.wheel.schedule(timer_, timeout_seconds_ * 1000);
 }
 /*
-@brief 取消计时
+@brief 空闲超时
 */
-void Connection::cancel_timer(){
-    if(timeout_seconds_ == 0) return;
-    timer_.cancel();
+void Connection::on_timeout(){
+    if(has_closed()) return;
+    //仍有处理中的请求或未发送完的回复 连接并非空闲 重新计时
+    if(pending_ > 0 || !outbox_.empty()){
+        reset_timer();
+        return;
+    }
+    //timeout时间到自动关闭连接 关闭时连接可能从连接表中释放 先持有自身
+    auto self = this->shared_from_this();
+    close();
 }
 /*
 @brief 关闭连接
 */
 void Connection::close(){
-    has_closed_ = true;
+    bool first_close = !has_closed_.exchange(true);
+    if(first_close && started_){
+        worker_.connections--;
+    }
     if(socket_.is_open()){
         boost::system::error_code ignored_ec;
         //关闭读写通道
@@ -172,6 +358,25 @@ void Connection::close(){
         //完全关闭套接字
         socket_.close(ignored_ec);
     }
+    if(first_close){
+        //从时间轮上摘下
+        worker_.wheel.cancel(timer_);
+        //唤醒阻塞在流式调用读写上的处理函数
+        for(auto &kv : streams_) kv.second->abort();
+        streams_.clear();
+        //没有人会再读取回复 正在执行的请求可以提前结束
+        for(auto &kv : cancels_){
+            kv.second.token.cancel();
+            worker_.wheel.cancel(kv.second.timer);
+        }
+        cancels_.clear();
+        //立即释放读缓冲区 不必等到连接对象析构
+        read_buf_.clear();
+    }
+    //最后再注销 注销可能释放连接表持有的引用
+    if(first_close && close_callback_){
+        close_callback_(conn_id);
+    }
 }
 }
 }
\ No newline at end of file
@@ -0,0 +1,65 @@
+#include "connection_table.h"
+#include "connection.h"
+
+namespace easy_rpc{
+namespace rpc_server{
+connection_table::shard& connection_table::get_shard(int64_t conn_id){
+    return shards_[(uint64_t)conn_id % shard_count];
+}
+/*
+@brief 注册连接
+*/
+void connection_table::add(int64_t conn_id, std::shared_ptr<Connection> conn){
+    auto &s = get_shard(conn_id);
+    std::unique_lock<std::mutex> lock(s.mtx);
+    s.conns.emplace(conn_id, std::move(conn));
+}
+/*
+@brief 注销连接 连接对象在锁外释放，避免析构时持有分片锁
+*/
+void connection_table::remove(int64_t conn_id){
+    std::shared_ptr<Connection> conn;
+    auto &s = get_shard(conn_id);
+    {
+        std::unique_lock<std::mutex> lock(s.mtx);
+        auto it = s.conns.find(conn_id);
+        if(it == s.conns.end()) return;
+        conn = std::move(it->second);
+        s.conns.erase(it);
+    }
+}
+/*
+@brief 查找连接 不存在时返回空指针
+*/
+std::shared_ptr<Connection> connection_table::find(int64_t conn_id){
+    auto &s = get_shard(conn_id);
+    std::unique_lock<std::mutex> lock(s.mtx);
+    auto it = s.conns.find(conn_id);
+    if(it == s.conns.end()) return nullptr;
+    return it->second;
+}
+/*
+@brief 当前连接数
+*/
+size_t connection_table::size(){
+    size_t n = 0;
+    for(auto &s : shards_){
+        std::unique_lock<std::mutex> lock(s.mtx);
+        n += s.conns.size();
+    }
+    return n;
+}
+/*
+@brief 清空所有连接
+*/
+void connection_table::clear(){
+    for(auto &s : shards_){
+        std::unordered_map<int64_t,std::shared_ptr<Connection>> conns;
+        {
+            std::unique_lock<std::mutex> lock(s.mtx);
+            conns.swap(s.conns);
+        }
+    }
+}
+}
+}
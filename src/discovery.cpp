@@ -0,0 +1,230 @@
+#include "discovery.h"
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+
+namespace easy_rpc{
+namespace{
+    /*
+    @brief 两个地址列表是否包含相同的地址 不比较负载
+    */
+    bool same_addresses(const std::vector<endpoint_info>& a, const std::vector<endpoint_info>& b){
+        if(a.size() != b.size()) return false;
+        for(auto &e : a){
+            auto it = std::find_if(b.begin(), b.end(), [&e](const endpoint_info& o){ return e.same_address(o); });
+            if(it == b.end()) return false;
+        }
+        return true;
+    }
+    /*
+    @brief 在列表中注册或更新地址
+    @return 是否新增了地址
+    */
+    bool upsert(std::vector<endpoint_info>& list, const endpoint_info& endpoint){
+        for(auto &e : list){
+            if(e.same_address(endpoint)){
+                e = endpoint;
+                return false;
+            }
+        }
+        list.push_back(endpoint);
+        return true;
+    }
+    /*
+    @brief 从列表中删除地址
+    @return 是否删除了地址
+    */
+    bool erase(std::vector<endpoint_info>& list, const std::string& host, unsigned short port){
+        auto it = std::remove_if(list.begin(), list.end(), [&](const endpoint_info& e){
+            return e.host == host && e.port == port;
+        });
+        bool removed = it != list.end();
+        list.erase(it, list.end());
+        return removed;
+    }
+    /*
+    @brief 当前的系统时间(毫秒) 多个进程共享注册文件，不能使用各自的steady_clock
+    */
+    int64_t now_ms(){
+        return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    }
+    /*
+    @brief 进程间的排他文件锁 锁在单独的锁文件上，注册文件每次写入都会被重命名替换，不能直接加锁
+    */
+    class file_lock{
+    public:
+        explicit file_lock(const std::string& path):fd_(::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644)){
+            if(fd_ >= 0) ::flock(fd_, LOCK_EX);
+        }
+        ~file_lock(){
+            if(fd_ < 0) return;
+            ::flock(fd_, LOCK_UN);
+            ::close(fd_);
+        }
+        file_lock(const file_lock&) = delete;
+        file_lock& operator=(const file_lock&) = delete;
+    private:
+        int fd_;
+    };
+}
+
+void local_registry::announce(const std::string& service, const endpoint_info& endpoint){
+    bool changed;
+    {
+        std::lock_guard<std::mutex> lock(mtx_);
+        changed = upsert(services_[service], endpoint);
+    }
+    notify(service, changed);
+}
+
+void local_registry::withdraw(const std::string& service, const std::string& host, unsigned short port){
+    bool changed;
+    {
+        std::lock_guard<std::mutex> lock(mtx_);
+        changed = erase(services_[service], host, port);
+    }
+    notify(service, changed);
+}
+
+std::vector<endpoint_info> local_registry::lookup(const std::string& service){
+    std::lock_guard<std::mutex> lock(mtx_);
+    auto it = services_.find(service);
+    return it == services_.end() ? std::vector<endpoint_info>() : it->second;
+}
+
+void local_registry::watch(const std::string& service, watcher_type watcher){
+    std::lock_guard<std::mutex> lock(mtx_);
+    watchers_.emplace(service, std::move(watcher));
+}
+/*
+@brief 地址列表变化时通知订阅者 回调在锁外执行，订阅者可以在回调中查询
+*/
+void local_registry::notify(const std::string& service, bool changed){
+    if(!changed) return;
+    std::vector<watcher_type> watchers;
+    std::vector<endpoint_info> endpoints;
+    {
+        std::lock_guard<std::mutex> lock(mtx_);
+        auto range = watchers_.equal_range(service);
+        for(auto it = range.first; it != range.second; ++it) watchers.push_back(it->second);
+        endpoints = services_[service];
+    }
+    for(auto &watcher : watchers) watcher(endpoints);
+}
+
+file_discovery::file_discovery(const std::string& path, size_t interval_ms, size_t lease_ms):path_(path),interval_ms_(interval_ms),lease_ms_(lease_ms){
+    known_ = load();
+    thd_ = std::thread([this]{ poll(); });
+}
+
+file_discovery::~file_discovery(){
+    {
+        std::lock_guard<std::mutex> lock(mtx_);
+        stop_ = true;
+    }
+    cond_.notify_all();
+    if(thd_.joinable()) thd_.join();
+}
+/*
+@brief 读取注册文件 文件不存在时为空 租约已过期的服务端被忽略，下一次写入时从文件中删除
+*/
+file_discovery::table_type file_discovery::load(){
+    table_type table;
+    std::ifstream in(path_);
+    std::string line;
+    int64_t now = now_ms();
+    while(std::getline(in, line)){
+        std::istringstream fields(line);
+        std::string service, methods;
+        endpoint_info endpoint;
+        if(!(fields >> service >> endpoint.host >> endpoint.port >> endpoint.load >> endpoint.announced_ms)) continue;
+        if(lease_ms_ > 0 && now - endpoint.announced_ms > (int64_t)lease_ms_) continue;
+        if(fields >> methods){
+            std::istringstream names(methods);
+            std::string name;
+            while(std::getline(names, name, ',')){
+                if(!name.empty()) endpoint.methods.push_back(name);
+            }
+        }
+        upsert(table[service], endpoint);
+    }
+    return table;
+}
+/*
+@brief 写入注册文件 先写临时文件再重命名 避免读者看到写了一半的文件
+调用者持有文件锁 临时文件不会被其他进程同时写入
+*/
+void file_discovery::save(const table_type& table){
+    std::string tmp = path_ + ".tmp";
+    {
+        std::ofstream out(tmp, std::ios::trunc);
+        for(auto &kv : table){
+            for(auto &e : kv.second){
+                out << kv.first << ' ' << e.host << ' ' << e.port << ' ' << e.load << ' ' << e.announced_ms << ' ';
+                for(size_t i = 0; i < e.methods.size(); i++){
+                    out << (i ? "," : "") << e.methods[i];
+                }
+                out << '\n';
+            }
+        }
+    }
+    std::rename(tmp.c_str(), path_.c_str());
+}
+
+/*
+@brief 读取、修改、写回注册文件期间持有进程间的文件锁 多个服务端同时注册或注销时不会互相覆盖
+*/
+void file_discovery::announce(const std::string& service, const endpoint_info& endpoint){
+    std::lock_guard<std::mutex> lock(mtx_);
+    file_lock flock(path_ + ".lock");
+    table_type table = load();
+    endpoint_info renewed = endpoint;
+    renewed.announced_ms = now_ms(); //每次上报都续约
+    upsert(table[service], renewed);
+    save(table);
+}
+
+void file_discovery::withdraw(const std::string& service, const std::string& host, unsigned short port){
+    std::lock_guard<std::mutex> lock(mtx_);
+    file_lock flock(path_ + ".lock");
+    table_type table = load();
+    if(erase(table[service], host, port)) save(table);
+}
+
+std::vector<endpoint_info> file_discovery::lookup(const std::string& service){
+    std::lock_guard<std::mutex> lock(mtx_);
+    table_type table = load();
+    auto it = table.find(service);
+    return it == table.end() ? std::vector<endpoint_info>() : it->second;
+}
+
+void file_discovery::watch(const std::string& service, watcher_type watcher){
+    std::lock_guard<std::mutex> lock(mtx_);
+    watchers_.emplace(service, std::move(watcher));
+}
+/*
+@brief 后台线程 按间隔重新读取注册文件 与上一次的注册信息比较地址列表，只通知发生变化的集群
+*/
+void file_discovery::poll(){
+    std::unique_lock<std::mutex> lock(mtx_);
+    while(!cond_.wait_for(lock, std::chrono::milliseconds(interval_ms_), [this]{ return stop_; })){
+        table_type table = load();
+        std::vector<std::pair<watcher_type, std::vector<endpoint_info>>> notices;
+        for(auto &kv : watchers_){
+            auto &now = table[kv.first];
+            if(!same_addresses(known_[kv.first], now)) notices.emplace_back(kv.second, now);
+        }
+        known_ = std::move(table);
+        if(notices.empty()) continue;
+        //回调在锁外执行
+        lock.unlock();
+        for(auto &notice : notices) notice.first(notice.second);
+        lock.lock();
+    }
+}
+}
@@ -1,14 +1,26 @@
 #include "io_pool.h"
 namespace easy_rpc{
 namespace rpc_server{
+/*
+@brief 估算io线程的负载 活跃连接各计1，排队中的请求各计4，平均每请求耗时每毫秒计1
+*/
+size_t io_worker::load() const{
+    return connections.load(memory_order_relaxed) + 4 * pending.load(memory_order_relaxed)
+        + (size_t)(busy_us.load(memory_order_relaxed) / 1000);
+}
+/*
+@brief 记录单个请求的处理耗时(一批请求取平均) 以1/8的权重更新滑动平均
+*/
+void io_worker::record_busy(uint64_t us){
+    uint64_t old = busy_us.load(memory_order_relaxed);
+    busy_us.store(old - old / 8 + us / 8, memory_order_relaxed);
+}
+
 io_pool::io_pool(size_t pool_size):next_io_service_(0){
     if(pool_size == 0) throw std::runtime_error("io_pool size is 0");
-    //初始化指定数量的io_services
+    //初始化指定数量的io线程
     for(std::size_t i=0;i<pool_size;i++){
-        io_service_ptr io_service(new boost::asio::io_service);
-        work_ptr work(new boost::asio::io_service::work(*io_service));
-        io_services_.push_back(io_service);
-        work_.push_back(work);
+        workers_.push_back(make_shared<io_worker>());
     }
 }
 /*
@@ -17,8 +29,8 @@ io_pool::io_pool(size_t pool_size):next_io_service_(0){
 void io_pool::run(){
     //注意：线程的执行周期是独立于threads以及指向他的指针的
     std::vector<std::shared_ptr<std::thread>> threads;
-    for(std::size_t i=0;i<io_services_.size();i++){
-        threads.emplace_back(std::make_shared<std::thread>([](io_service_ptr svr){svr->run();},io_services_[i]));
+    for(std::size_t i=0;i<workers_.size();i++){
+        threads.emplace_back(std::make_shared<std::thread>([](io_worker_ptr worker){worker->io_service.run();},workers_[i]));
     }
     for(std::size_t i=0;i<threads.size();i++) threads[i]->join();
 }
@@ -26,18 +38,45 @@ void io_pool::run(){
 @brief 停止线程池 停止所有io_services
 */
 void io_pool::stop(){
-    for(std::size_t i=0;i<io_services_.size();i++){
-        io_services_[i]->stop();
+    for(std::size_t i=0;i<workers_.size();i++){
+        workers_[i]->io_service.stop();
+    }
+}
+/*
+@brief 从线程池获取当前负载最低的io线程 负载相同时按轮询顺序选择
+*/
+io_worker & io_pool::get_worker(){
+    size_t best = next_io_service_;
+    size_t best_load = workers_[best]->load();
+    for(size_t i=1;i<workers_.size() && best_load > 0;i++){
+        size_t idx = (next_io_service_ + i) % workers_.size();
+        size_t load = workers_[idx]->load();
+        if(load < best_load){
+            best = idx;
+            best_load = load;
+        }
     }
+    ++next_io_service_;
+    if(next_io_service_ == workers_.size()) next_io_service_ = 0;
+    return *workers_[best];
+}
+/*
+@brief 获取指定序号的io线程
+*/
+io_worker & io_pool::get_worker(size_t index){
+    return *workers_[index];
+}
+/*
+@brief io线程数量
+*/
+size_t io_pool::size() const{
+    return workers_.size();
 }
 /*
 @brief 从线程池获取一个io_service
 */
 boost::asio::io_service &  io_pool::get_io_service(){
-    boost::asio::io_service& io_service = *io_services_[next_io_service_];
-    ++next_io_service_;
-    if(next_io_service_ == io_services_.size()) next_io_service_ = 0;
-    return io_service;
+    return get_worker().io_service;
 }
 }
 }
@@ -0,0 +1,10 @@
+#include "request_arena.h"
+
+namespace easy_rpc{
+namespace rpc_server{
+request_arena& request_arena::current(){
+    thread_local request_arena arena;
+    return arena;
+}
+}
+}
@@ -0,0 +1,56 @@
+#include "response_handle.h"
+#include "connection.h"
+
+namespace easy_rpc{
+namespace rpc_server{
+response_handle::response_handle(Connection* conn, uint64_t req_id):state_(std::make_shared<state>()){
+    state_->conn = conn->shared_from_this();
+    state_->conn_id = conn->get_conn_id();
+    state_->req_id = req_id;
+    state_->deadline = call_deadline::current();
+    state_->token = cancel_token::current();
+}
+/*
+@brief 获取连接id
+*/
+int64_t response_handle::conn_id() const{
+    return state_ ? state_->conn_id : -1;
+}
+/*
+@brief 获取请求id
+*/
+uint64_t response_handle::req_id() const{
+    return state_ ? state_->req_id : 0;
+}
+
+deadline_type response_handle::deadline() const{
+    return state_ ? state_->deadline : no_deadline;
+}
+
+std::chrono::milliseconds response_handle::remaining() const{
+    return call_deadline::remaining(deadline());
+}
+
+bool response_handle::cancelled() const{
+    return !state_ || state_->token.cancelled();
+}
+
+bool response_handle::expired() const{
+    if(!state_) return true;
+    auto conn = state_->conn.lock();
+    return !conn || conn->has_closed();
+}
+/*
+@brief 将打包好的回复交给连接发送 连接内部会转到其io线程中处理
+*/
+void response_handle::send(buffer_type && data) const{
+    if(!state_ || state_->done.exchange(true)) return;
+    if(data.size() >= MAX_BUF_LEN){
+        data.clear();
+        msgpack_codec::pack_args_to(data, result_code::FAIL, "The response result is out of range.");
+    }
+    auto conn = state_->conn.lock();
+    if(conn) conn->response(state_->req_id, std::move(data));
+}
+}
+}
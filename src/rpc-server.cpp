@@ -1,4 +1,5 @@
 #include "rpc-server.h"
+#include <unistd.h>
 namespace easy_rpc{
 namespace rpc_server{
 /*
@@ -6,79 +7,222 @@ namespace rpc_server{
 @param port 服务端口号
 @param size io服务池大小
 @param timeout_seds 请求超时时间
-@param check_seds 检查时间间隔
+@param check_seds 已废弃 连接关闭时即时回收，不再定时检查，保留该参数以兼容旧接口
 */
-RpcServer::RpcServer(short port, size_t size, size_t timeout_seds, size_t check_seds)
-    :io_pool_(size),acceptor_(io_pool_.get_io_service(), tcp::endpoint(tcp::v4(),port)),
-    timeout_second_(timeout_seds),__check_seconds_(check_seds)
+RpcServer::RpcServer(short port, size_t size, size_t timeout_seds, size_t /*check_seds*/)
+    :io_pool_(size),port_(port),
+    timeout_second_(timeout_seds)
 {
     //设置路由的回调函数
-    Router::get().set_callback(std::bind(&RpcServer::callback, this, std::placeholders::_1,std::placeholders::_2,std::placeholders::_3,std::placeholders::_4));
-    //开始接受连接
-    do_accept();
-    //创建连接检查线程
-    check_thread_ = std::make_shared<std::thread>([this]{clean();});
+    Router::get().set_callback(std::bind(&RpcServer::callback, this, std::placeholders::_1,std::placeholders::_2,std::placeholders::_3,std::placeholders::_4,std::placeholders::_5));
 }
 
 RpcServer::~RpcServer(){
-    stop_check_ = true;
-    check_thread_->join(); //等待检查线程结束
+    if(announce_thd_.joinable()){
+        {
+            std::lock_guard<std::mutex> lock(announce_mtx_);
+            announce_stop_ = true;
+        }
+        announce_cond_.notify_all();
+        announce_thd_.join(); //先停止上报 避免注销之后又被重新注册
+    }
+    if(discovery_){
+        //先从服务发现中注销 客户端不再向本服务端建立新连接
+        discovery_->withdraw(service_, host_, port_);
+    }
+    if(worker_pool_){
+        //在io线程停止之前停止计算线程池 排队中的请求回复错误，正在执行的请求正常回复
+        //io线程仍在调用route 此时不能清空Router中的线程池指针 停止后的线程池拒绝新任务
+        worker_pool_->stop();
+        if(thd_) flush_io();
+    }
     io_pool_.stop();//关闭连接池
-    thd_->join();
+    if(thd_) thd_->join();
+    connections_.clear();
+    if(worker_pool_){
+        Router::get().set_worker_pool(nullptr); //io线程已退出 不再有route读取该指针
+    }
 }
 /*
-@brief 接受客户端连接 该接受函数在子线程中往复执行，实质上是在遍历服务池中的所有io连接，并将有连接请求的连接加入本地连接中
+@brief 等待各io线程处理完已排队的任务 回复先在io线程中入队再安排发送，需要两轮
 */
-void RpcServer::do_accept(){
-    conn_.reset(new Connection(io_pool_.get_io_service(), timeout_second_));
-    //异步接受连接
-    acceptor_.async_accept(conn_->socket(), [this](boost::system::error_code ec){
-        if(!ec){
-            conn_->start();//连接建立 
-            std::unique_lock<std::mutex> lock(mtx_);
-            conn_->set_conn_id(conn_id);
-            connections_.emplace(conn_id ++ , conn_);
+void RpcServer::flush_io(){
+    for(int round = 0; round < 2; round++){
+        for(size_t i=0;i<io_pool_.size();i++){
+            std::promise<void> done;
+            boost::asio::post(io_pool_.get_worker(i).io_service, [&done]{ done.set_value(); });
+            done.get_future().wait();
         }
-        do_accept();
-    });
+    }
 }
 /*
-@brief check线程执行的函数 清理超时或者不再使用的连接
+@brief 在指定的io_service上创建监听端口的接受器
 */
-void RpcServer::clean(){
-    while(!stop_check_){
-        //检查时间阻塞 避免频繁检查
-        std::this_thread::sleep_for(std::chrono::seconds(__check_seconds_));
-        std::unique_lock<std::mutex> lock(mtx_);
-        for(auto it= connections_.cbegin();it != connections_.cend();){
-            if(it->second->has_closed()){
-                //注意：erase后返回的迭代器是删除位置的后一个
-                it = connections_.erase(it);
-            }else it ++;
-        }
+RpcServer::acceptor_ptr RpcServer::listen(boost::asio::io_service& io_service){
+    tcp::endpoint endpoint(tcp::v4(), port_);
+    auto acceptor = std::make_shared<tcp::acceptor>(io_service);
+    acceptor->open(endpoint.protocol());
+    acceptor->set_option(tcp::acceptor::reuse_address(true));
+    if(reuse_port_){
+#ifdef SO_REUSEPORT
+        //多个接受器绑定同一端口 由内核在各接受器之间分配新连接
+        typedef boost::asio::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT> reuse_port;
+        acceptor->set_option(reuse_port(true));
+#else
+        throw std::runtime_error("SO_REUSEPORT is not supported on this platform");
+#endif
     }
+    acceptor->bind(endpoint);
+    acceptor->listen();
+    return acceptor;
 }
 /*
-@brief Router回调函数 将函数调用结果返回客户端
+@brief 接受客户端连接 接受完成后继续等待下一个连接
+@param acceptor 接受器
+@param worker 连接所属的io线程 为空时在连接到达时分配到当前负载最低的io线程
 */
-void RpcServer::callback(const std::string &topic, std::string&& result,Connection * conn, bool has_error){
-    response(conn->get_conn_id(), std::move(result));
+void RpcServer::do_accept(acceptor_ptr acceptor, io_worker* worker){
+    if(!worker){
+        //连接到达时才按当时的负载选择io线程 空闲的服务端上等待连接的时间可能很长，提前选择会依据过时的负载
+        //先接受到接受器所在的io线程，再把socket的句柄转交给选中的io线程
+        acceptor->async_accept([this,acceptor](boost::system::error_code ec, tcp::socket peer){
+            if(!ec){
+                std::shared_ptr<Connection> conn(new Connection(io_pool_.get_worker(), timeout_second_));
+                auto protocol = acceptor->local_endpoint(ec).protocol();
+                if(!ec){
+                    auto handle = peer.release(ec);
+                    if(!ec){
+                        conn->socket().assign(protocol, handle, ec);
+                        if(ec) ::close(handle);
+                    }
+                }
+                if(!ec) accepted(conn);
+            }
+            do_accept(acceptor, nullptr);
+        });
+        return;
+    }
+    std::shared_ptr<Connection> conn(new Connection(*worker, timeout_second_));
+    //异步接受连接
+    acceptor->async_accept(conn->socket(), [this,acceptor,worker,conn](boost::system::error_code ec){
+        if(!ec) accepted(conn);
+        do_accept(acceptor, worker);
+    });
+}
+/*
+@brief 登记新接受的连接并开始读取
+*/
+void RpcServer::accepted(std::shared_ptr<Connection> conn){
+    int64_t id = conn_id++;
+    conn->set_conn_id(id);
+    //连接关闭时立即从连接表中注销
+    conn->set_close_callback([this](int64_t id){connections_.remove(id);});
+    conn->set_watermark(high_watermark_, low_watermark_);
+    connections_.add(id, conn);
+    conn->start();//连接建立 先分配id再开始读取 保证处理函数拿到的连接id有效
+}
+/*
+@brief Router回调函数 将函数调用结果返回客户端 调用方持有连接 直接回复而无需查找连接表
+*/
+void RpcServer::callback(std::string_view topic, buffer_type&& result,Connection * conn, uint64_t req_id, bool has_error){
+    conn->response(req_id, std::move(result));
 }
 /*
-@brief 运行RPC服务端
+@brief 运行RPC服务端 开始监听端口并接受连接
 */
 void RpcServer::run(){
+    if(reuse_port_){
+        //每个io线程拥有自己的接受器 接受的连接始终留在该线程上 不发生跨线程的转交
+        for(size_t i=0;i<io_pool_.size();i++){
+            io_worker& worker = io_pool_.get_worker(i);
+            acceptors_.push_back(listen(worker.io_service));
+            do_accept(acceptors_.back(), &worker);
+        }
+    }else{
+        acceptors_.push_back(listen(io_pool_.get_io_service()));
+        do_accept(acceptors_.back(), nullptr);
+    }
+    if(discovery_){
+        announce();
+        announce_thd_ = std::thread([this]{ announce_loop(); });
+    }
     //启动服务线程，服务线程实质是创建IO服务池 该线程会等待所有服务线程结束 
     thd_ = std::make_shared<std::thread>([this]{io_pool_.run();});
 }
 /*
+@brief 启用计算线程池 以ExecPolicy::offload注册的处理函数将在其中执行，需在run之前调用
+@param pool_size 计算线程数量
+@param max_queue 排队任务上限 超出时直接回复服务繁忙
+*/
+void RpcServer::set_worker_pool(size_t pool_size, size_t max_queue){
+    worker_pool_.reset(new worker_pool(pool_size, max_queue));
+    Router::get().set_worker_pool(worker_pool_.get());
+}
+/*
+@brief 设置是否启用SO_REUSEPORT多接受器模式，需在run之前调用
+启用后每个io线程各自监听端口并处理自己接受的连接，各线程之间不共享连接
+*/
+void RpcServer::set_reuse_port(bool enable){
+    reuse_port_ = enable;
+}
+/*
+@brief 设置每个连接回复队列的高低水位，需在run之前调用
+某个连接的回复堆积超过高水位时暂停读取其请求，直到客户端取走回复、队列回落到低水位以下
+@param high 高水位 字节数
+@param low 低水位 字节数
+*/
+void RpcServer::set_write_watermark(size_t high, size_t low){
+    high_watermark_ = high;
+    low_watermark_ = low;
+}
+/*
+@brief 启用服务发现，需在run之前调用 启动后注册本服务端的地址与服务列表，之后定期上报负载，析构时注销
+@param registry 服务发现
+@param service 服务集群名称
+@param host 客户端连接本服务端使用的地址
+@param announce_seconds 上报负载的间隔 同时为注册续约，应小于服务发现中注册的有效期
+*/
+void RpcServer::set_discovery(std::shared_ptr<discovery> registry, const std::string& service, const std::string& host, size_t announce_seconds){
+    discovery_ = std::move(registry);
+    service_ = service;
+    host_ = host;
+    announce_seconds_ = announce_seconds;
+}
+/*
+@brief 向服务发现注册/更新本服务端 负载为各io线程负载之和
+*/
+void RpcServer::announce(){
+    endpoint_info endpoint;
+    endpoint.host = host_;
+    endpoint.port = port_;
+    endpoint.methods = Router::get().handler_names();
+    for(size_t i=0;i<io_pool_.size();i++){
+        endpoint.load += io_pool_.get_worker(i).load();
+    }
+    try{
+        discovery_->announce(service_, endpoint);
+    }catch(const std::exception& e){
+        std::cout << "announce failed: " << e.what() << std::endl;
+    }
+}
+/*
+@brief 上报线程 每隔announce_seconds_上报一次负载，析构时被唤醒退出
+*/
+void RpcServer::announce_loop(){
+    std::unique_lock<std::mutex> lock(announce_mtx_);
+    while(!announce_cond_.wait_for(lock, std::chrono::seconds(announce_seconds_), [this]{ return announce_stop_; })){
+        lock.unlock();
+        announce();
+        lock.lock();
+    }
+}
+/*
 @brief 向指定连接回复数据
 */
-void RpcServer::response(int64_t conn_id, std::string && result){
-    std::unique_lock<mutex> lock(mtx_);
-    auto it = connections_.find(conn_id);
-    if(it != connections_.end()) {
-        it->second->response(std::move(result));
+void RpcServer::response(int64_t conn_id, uint64_t req_id, buffer_type && result){
+    auto conn = connections_.find(conn_id);
+    if(conn) {
+        conn->response(req_id, std::move(result));
     }
 }
 }
@@ -0,0 +1,136 @@
+#include "stream_handle.h"
+#include "connection.h"
+
+namespace easy_rpc{
+namespace rpc_server{
+/*
+@brief 对端补充发送额度
+*/
+void stream_state::grant(uint32_t credits){
+    std::lock_guard<std::mutex> lock(mtx_);
+    credits_ += credits;
+    cond_.notify_all();
+}
+/*
+@brief 收到客户端上传的一块数据
+@return 客户端超出额度继续发送时返回false 数据被丢弃
+*/
+bool stream_state::push(std::string && chunk){
+    std::lock_guard<std::mutex> lock(mtx_);
+    if(unacked_ >= STREAM_WINDOW) return false;
+    unacked_++;
+    if(input_end_) return true;
+    inbox_.push_back(std::move(chunk));
+    cond_.notify_all();
+    return true;
+}
+/*
+@brief 客户端结束上传
+*/
+void stream_state::end_input(){
+    std::lock_guard<std::mutex> lock(mtx_);
+    input_end_ = true;
+    cond_.notify_all();
+}
+/*
+@brief 连接关闭 唤醒所有阻塞中的读写
+*/
+void stream_state::abort(){
+    std::lock_guard<std::mutex> lock(mtx_);
+    aborted_ = true;
+    cond_.notify_all();
+}
+
+bool stream_state::acquire_credit(){
+    std::unique_lock<std::mutex> lock(mtx_);
+    cond_.wait(lock, [this]{ return credits_ > 0 || aborted_ || done; });
+    if(aborted_ || done) return false;
+    credits_--;
+    return true;
+}
+
+bool stream_state::pop(std::string & chunk, uint32_t & consumed){
+    std::unique_lock<std::mutex> lock(mtx_);
+    cond_.wait(lock, [this]{ return !inbox_.empty() || input_end_ || aborted_; });
+    if(inbox_.empty()) return false;
+    chunk = std::move(inbox_.front());
+    inbox_.pop_front();
+    //客户端每次补充一半窗口的额度 减少额度消息的数量
+    if(++consumed_ >= STREAM_WINDOW / 2){
+        consumed = consumed_;
+        consumed_ = 0;
+        unacked_ -= consumed; //额度随后补充给客户端
+    }else{
+        consumed = 0;
+    }
+    return true;
+}
+
+stream_handle::stream_handle(Connection* conn, uint64_t req_id):state_(std::make_shared<stream_state>()){
+    state_->conn = conn->shared_from_this();
+    state_->conn_id = conn->get_conn_id();
+    state_->req_id = req_id;
+    //句柄在io线程中构造 登记后该请求id上后续的数据块与额度消息才能送达
+    conn->add_stream(req_id, state_);
+}
+/*
+@brief 获取连接id
+*/
+int64_t stream_handle::conn_id() const{
+    return state_ ? state_->conn_id : -1;
+}
+/*
+@brief 获取请求id
+*/
+uint64_t stream_handle::req_id() const{
+    return state_ ? state_->req_id : 0;
+}
+
+bool stream_handle::expired() const{
+    if(!state_) return true;
+    auto conn = state_->conn.lock();
+    return !conn || conn->has_closed();
+}
+
+bool stream_handle::read(std::string & chunk) const{
+    if(!state_) return false;
+    uint32_t consumed = 0;
+    if(!state_->pop(chunk, consumed)) return false;
+    if(consumed > 0){
+        //为客户端补充上传额度
+        buffer_type buffer = buffer_pool::acquire();
+        buffer.write((const char*)&consumed, sizeof(uint32_t));
+        auto conn = state_->conn.lock();
+        if(conn) conn->response(state_->req_id, std::move(buffer), frame_type::credit);
+    }
+    return true;
+}
+/*
+@brief 将打包好的数据块或最终结果交给连接发送 最终结果只发送一次
+*/
+void stream_handle::send(buffer_type && data, frame_type type) const{
+    if(!state_){
+        buffer_pool::release(std::move(data));
+        return;
+    }
+    if(type == frame_type::stream_end){
+        if(state_->done.exchange(true)) return;
+        if(data.size() >= MAX_BUF_LEN){
+            data.clear();
+            msgpack_codec::pack_args_to(data, result_code::FAIL, "The response result is out of range.");
+        }
+        //唤醒可能仍在等待额度的写操作
+        state_->grant(0);
+    }else if(state_->done){
+        buffer_pool::release(std::move(data));
+        return;
+    }
+    auto conn = state_->conn.lock();
+    if(conn){
+        conn->response(state_->req_id, std::move(data), type);
+    }else{
+        buffer_pool::release(std::move(data));
+    }
+}
+}
+}
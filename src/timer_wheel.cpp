@@ -0,0 +1,168 @@
+#include "timer_wheel.h"
+
+namespace easy_rpc{
+namespace rpc_server{
+namespace{
+    //将节点插入到哨兵之前 即链表尾部
+    void link_before(timer_wheel::node& head, timer_wheel::node& n){
+        n.prev = head.prev;
+        n.next = &head;
+        head.prev->next = &n;
+        head.prev = &n;
+    }
+    void init_head(timer_wheel::node& head){
+        head.prev = head.next = &head;
+    }
+}
+
+timer_wheel::timer_wheel(boost::asio::io_service& io_service, uint32_t tick_ms):
+timer_(io_service),start_(std::chrono::steady_clock::now()),tick_ms_(tick_ms == 0 ? 1 : tick_ms){
+    for(auto &head : root_) init_head(head);
+    for(auto &level : levels_){
+        for(auto &head : level) init_head(head);
+    }
+}
+/*
+@brief 当前tick
+*/
+uint64_t timer_wheel::now() const{
+    return current_tick_;
+}
+
+uint32_t timer_wheel::tick_ms() const{
+    return tick_ms_;
+}
+
+uint64_t timer_wheel::real_tick() const{
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start_);
+    return (uint64_t)elapsed.count() / tick_ms_;
+}
+/*
+@brief 设置节点在delay_ms毫秒后到期 到期时间只会推迟的情况下不移动节点，仅记录新的到期tick，
+节点所在的槽到期时再按新的到期时间重新挂载，因此频繁续期的空闲超时几乎没有开销
+*/
+void timer_wheel::schedule(node& n, uint64_t delay_ms){
+    if(count_ == 0 && !running_){
+        //时间轮为空时没有驱动定时器 直接对齐到真实时间
+        current_tick_ = real_tick();
+    }
+    uint64_t deadline = current_tick_ + (delay_ms + tick_ms_ - 1) / tick_ms_;
+    if(n.linked()){
+        if(deadline >= n.deadline){
+            n.deadline = deadline;
+            return;
+        }
+        //提前到期 移到新的槽 节点数不变
+        unlink(n);
+    }else{
+        count_++;
+    }
+    n.deadline = deadline;
+    add(n);
+    if(!running_) arm();
+}
+/*
+@brief 取消节点 未挂载的节点直接忽略
+*/
+void timer_wheel::cancel(node& n){
+    if(!n.linked()) return;
+    unlink(n);
+    count_--;
+}
+
+void timer_wheel::unlink(node& n){
+    n.prev->next = n.next;
+    n.next->prev = n.prev;
+    n.prev = n.next = nullptr;
+}
+/*
+@brief 按距离到期的tick数选择层级和槽
+*/
+void timer_wheel::add(node& n){
+    if(n.deadline < current_tick_) n.deadline = current_tick_;
+    uint64_t delta = n.deadline - current_tick_;
+    if(delta < ROOT_SIZE){
+        link_before(root_[n.deadline & (ROOT_SIZE - 1)], n);
+        return;
+    }
+    for(int level = 0; level < LEVELS; level++){
+        int shift = ROOT_BITS + (level + 1) * LEVEL_BITS;
+        if(level == LEVELS - 1 || delta < ((uint64_t)1 << shift)){
+            uint64_t deadline = n.deadline;
+            if(delta >= ((uint64_t)1 << shift)){
+                //超出时间轮的最大跨度 先挂在最远的槽上 到期后再重新计算
+                deadline = current_tick_ + ((uint64_t)1 << shift) - 1;
+            }
+            size_t index = (deadline >> (ROOT_BITS + level * LEVEL_BITS)) & (LEVEL_SIZE - 1);
+            link_before(levels_[level][index], n);
+            return;
+        }
+    }
+}
+/*
+@brief 将高层槽中的节点重新挂载到更低的层级
+*/
+void timer_wheel::cascade(int level, size_t index){
+    node &head = levels_[level][index];
+    while(head.next != &head){
+        node &n = *head.next;
+        unlink(n);
+        add(n);
+    }
+}
+/*
+@brief 处理当前tick到期的槽 回调前节点已摘下，回调中可以安全地重新调度或释放该节点
+*/
+void timer_wheel::run_tick(){
+    size_t index = current_tick_ & (ROOT_SIZE - 1);
+    if(index == 0){
+        for(int level = 0; level < LEVELS; level++){
+            size_t idx = (current_tick_ >> (ROOT_BITS + level * LEVEL_BITS)) & (LEVEL_SIZE - 1);
+            cascade(level, idx);
+            if(idx != 0) break;
+        }
+    }
+    node expired;
+    init_head(expired);
+    node &head = root_[index];
+    if(head.next != &head){
+        //整个槽移到临时链表 避免回调中新加入的节点在本轮被处理
+        expired.next = head.next;
+        expired.prev = head.prev;
+        expired.next->prev = &expired;
+        expired.prev->next = &expired;
+        init_head(head);
+    }
+    current_tick_++;
+    while(expired.next != &expired){
+        node &n = *expired.next;
+        unlink(n);
+        if(n.deadline >= current_tick_){
+            //节点被延后过 按新的到期时间重新挂载
+            add(n);
+            continue;
+        }
+        count_--;
+        n.callback();
+    }
+}
+/*
+@brief 驱动定时器 按真实时间补齐落后的tick 没有节点时停止
+*/
+void timer_wheel::arm(){
+    running_ = true;
+    timer_.expires_after(std::chrono::milliseconds(tick_ms_));
+    timer_.async_wait([this](const boost::system::error_code& ec){
+        if(!ec){
+            uint64_t target = real_tick();
+            while(current_tick_ < target && count_ > 0) run_tick();
+            if(count_ > 0){
+                arm();
+                return;
+            }
+        }
+        running_ = false;
+    });
+}
+}
+}
@@ -0,0 +1,69 @@
+#include "worker_pool.h"
+#include <stdexcept>
+namespace easy_rpc{
+namespace rpc_server{
+/*
+@brief 构造函数 创建并启动工作线程
+@param pool_size 工作线程数量
+@param max_queue 等待执行的任务数上限
+*/
+worker_pool::worker_pool(size_t pool_size, size_t max_queue):max_queue_(max_queue){
+    if(pool_size == 0) throw std::runtime_error("worker_pool size is 0");
+    for(size_t i=0;i<pool_size;i++){
+        threads_.emplace_back([this]{loop();});
+    }
+}
+
+worker_pool::~worker_pool(){
+    stop();
+}
+/*
+@brief 提交任务 队列已满或线程池已停止时返回false
+@param reject 线程池停止时任务仍未执行则调用
+*/
+bool worker_pool::try_post(std::function<void()> task, std::function<void()> reject){
+    {
+        std::unique_lock<std::mutex> lock(mtx_);
+        if(stop_ || tasks_.size() >= max_queue_) return false;
+        tasks_.push_back({std::move(task), std::move(reject)});
+    }
+    cond_.notify_one();
+    return true;
+}
+/*
+@brief 停止线程池 未执行的任务调用其拒绝函数，正在执行的任务执行完后返回
+*/
+void worker_pool::stop(){
+    std::deque<task_t> dropped;
+    {
+        std::unique_lock<std::mutex> lock(mtx_);
+        if(stop_) return;
+        stop_ = true;
+        dropped.swap(tasks_);
+    }
+    cond_.notify_all();
+    for(auto &task : dropped){
+        if(task.reject) task.reject();
+    }
+    for(auto &t : threads_){
+        if(t.joinable()) t.join();
+    }
+}
+/*
+@brief 工作线程循环 取出任务并执行
+*/
+void worker_pool::loop(){
+    while(true){
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(mtx_);
+            cond_.wait(lock, [this]{return stop_ || !tasks_.empty();});
+            if(stop_) return;
+            task = std::move(tasks_.front().run);
+            tasks_.pop_front();
+        }
+        task();
+    }
+}
+}
+}